@@ -0,0 +1,10 @@
+#include "testApp.h"
+#include "ofAppNoWindow.h"
+
+//--------------------------------------------------------------
+int main(int argc, char *argv[])
+{
+	ofAppNoWindow window; // command line only, nothing is drawn
+	ofSetupOpenGL(&window, 0, 0, OF_WINDOW);
+	ofRunApp(new testApp(vector<string>(argv + 1, argv + argc)));
+}
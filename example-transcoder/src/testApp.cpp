@@ -0,0 +1,182 @@
+#include "testApp.h"
+
+#include "Poco/Environment.h"
+
+//--------------------------------------------------------------
+void testApp::setup()
+{
+	ofSetFrameRate(2);
+	
+	next_file = num_done = num_failed = 0;
+	frames_written = bytes_written = raw_bytes = 0;
+	
+	ofxNI2::Transcoder::Settings settings;
+	int num_jobs = Poco::Environment::processorCount();
+	string output_dir;
+	
+	if (!parseArgs(settings, num_jobs, output_dir) || inputs.empty())
+	{
+		cout << "usage: example-transcoder [-j jobs] [-o dir] [-crop x y w h] [-scale n] [-skip n] file.oni|dir ..." << endl;
+		ofExit(1);
+		return;
+	}
+	
+	// not thread safe, the jobs would all call it
+	ofxNI2::init();
+	
+	num_jobs = ofClamp(num_jobs, 1, inputs.size());
+	
+	for (int i = 0; i < num_jobs; i++)
+	{
+		Job *job = new Job(this);
+		job->transcoder.setup(settings);
+		job->startThread(true, false);
+		jobs.push_back(job);
+	}
+	
+	cout << "transcoding " << inputs.size() << " files with " << num_jobs << " jobs" << endl;
+	
+	start_time = last_report = ofGetElapsedTimef();
+}
+
+void testApp::exit()
+{
+	for (int i = 0; i < jobs.size(); i++)
+	{
+		jobs[i]->stopThread();
+		jobs[i]->transcoder.cancel();
+		jobs[i]->waitForThread(false);
+		delete jobs[i];
+	}
+	
+	jobs.clear();
+}
+
+//--------------------------------------------------------------
+void testApp::update()
+{
+	if (jobs.empty()) return;
+	
+	mutex.lock();
+	
+	const float t = ofGetElapsedTimef() - start_time;
+	
+	if (num_done == inputs.size())
+	{
+		mutex.unlock();
+		
+		cout << num_done - num_failed << " files, " << frames_written << " frames in " << ofToString(t, 1) << "s, "
+			<< ofToString(frames_written / std::max(t, 0.001f), 0) << " fps, "
+			<< (bytes_written >> 20) << "MB, ratio " << ofToString(raw_bytes > 0 ? (double)bytes_written / raw_bytes : 0, 3) << endl;
+		
+		if (num_failed > 0)
+			cout << num_failed << " files failed" << endl;
+		
+		ofExit(num_failed > 0 ? 1 : 0);
+		return;
+	}
+	
+	if (ofGetElapsedTimef() - last_report < 5)
+	{
+		mutex.unlock();
+		return;
+	}
+	
+	last_report = ofGetElapsedTimef();
+	
+	cout << num_done << "/" << inputs.size() << " files, " << ofToString(frames_written / std::max(t, 0.001f), 0) << " fps";
+	
+	for (int i = 0; i < jobs.size(); i++)
+		cout << (i == 0 ? " [" : " ") << ofToString(jobs[i]->transcoder.getProgress() * 100, 0) << "%";
+	
+	cout << "]" << endl;
+	
+	mutex.unlock();
+}
+
+//--------------------------------------------------------------
+bool testApp::nextFile(int &index)
+{
+	ofScopedLock lock(mutex);
+	
+	if (next_file >= inputs.size()) return false;
+	
+	index = next_file++;
+	return true;
+}
+
+void testApp::fileDone(int index, ofxNI2::Transcoder &transcoder, bool ok)
+{
+	ofScopedLock lock(mutex);
+	
+	num_done++;
+	
+	if (!ok)
+	{
+		num_failed++;
+		cout << "failed " << inputs[index] << endl;
+		return;
+	}
+	
+	frames_written += transcoder.getNumFramesWritten();
+	bytes_written += transcoder.getBytesWritten();
+	raw_bytes += transcoder.getRawBytes();
+	
+	cout << inputs[index] << " -> " << outputs[index] << ", " << transcoder.getNumFramesWritten() << " frames" << endl;
+}
+
+//--------------------------------------------------------------
+bool testApp::parseArgs(ofxNI2::Transcoder::Settings &settings, int &num_jobs, string &output_dir)
+{
+	vector<string> paths;
+	
+	for (int i = 0; i < args.size(); i++)
+	{
+		const string &a = args[i];
+		const int left = args.size() - i - 1;
+		
+		if (a == "-j" && left >= 1) num_jobs = ofToInt(args[++i]);
+		else if (a == "-o" && left >= 1) output_dir = args[++i];
+		else if (a == "-scale" && left >= 1) settings.downscale = ofToInt(args[++i]);
+		else if (a == "-skip" && left >= 1) settings.decimation = ofToInt(args[++i]);
+		else if (a == "-crop" && left >= 4)
+		{
+			settings.depth_crop.x = ofToInt(args[i + 1]);
+			settings.depth_crop.y = ofToInt(args[i + 2]);
+			settings.depth_crop.width = ofToInt(args[i + 3]);
+			settings.depth_crop.height = ofToInt(args[i + 4]);
+			i += 4;
+		}
+		else if (!a.empty() && a[0] == '-') return false;
+		else paths.push_back(a);
+	}
+	
+	if (!output_dir.empty()) ofDirectory::createDirectory(output_dir, false, true);
+	
+	for (int i = 0; i < paths.size(); i++)
+		addInput(paths[i], output_dir);
+	
+	return true;
+}
+
+void testApp::addInput(const string& path, const string& output_dir)
+{
+	ofFile file(path, ofFile::Reference, false);
+	
+	if (file.isDirectory())
+	{
+		ofDirectory dir(path);
+		dir.allowExt("oni");
+		dir.listDir();
+		
+		for (int i = 0; i < dir.size(); i++)
+			addInput(dir.getPath(i), output_dir);
+		
+		return;
+	}
+	
+	const string dir = output_dir.empty() ? file.getEnclosingDirectory() : output_dir;
+	
+	inputs.push_back(file.getAbsolutePath());
+	outputs.push_back(ofFilePath::join(dir, file.getBaseName() + ".ni2r"));
+}
@@ -0,0 +1,65 @@
+#pragma once
+
+#include "ofMain.h"
+
+#include "ofxNI2.h"
+#include "utils/Transcoder.h"
+
+// example-transcoder [-j jobs] [-o dir] [-crop x y w h] [-scale n] [-skip n] file.oni|dir ...
+//
+// converts .oni files, or every .oni in a directory, to .ni2r recordings
+// that RecordingReader opens. -j files are converted at once, one per
+// core by default. output goes next to each input or into -o dir.
+
+class testApp : public ofBaseApp
+{
+public:
+	testApp(const vector<string>& args) : args(args) {}
+	
+	void setup();
+	void exit();
+	
+	void update();
+	
+	bool nextFile(int &index);
+	void fileDone(int index, ofxNI2::Transcoder &transcoder, bool ok);
+	
+	vector<string> inputs, outputs;
+	
+protected:
+	
+	class Job : public ofThread
+	{
+	public:
+		
+		Job(testApp *app) : app(app) {}
+		
+		ofxNI2::Transcoder transcoder;
+		
+	protected:
+		
+		testApp *app;
+		
+		void threadedFunction()
+		{
+			int i;
+			while (isThreadRunning() && app->nextFile(i))
+			{
+				const bool ok = transcoder.transcode(app->inputs[i], app->outputs[i]);
+				app->fileDone(i, transcoder, ok);
+			}
+		}
+	};
+	
+	vector<string> args;
+	vector<Job*> jobs;
+	
+	ofMutex mutex;
+	int next_file, num_done, num_failed;
+	uint64_t frames_written, bytes_written, raw_bytes;
+	
+	float start_time, last_report;
+	
+	bool parseArgs(ofxNI2::Transcoder::Settings &settings, int &num_jobs, string &output_dir);
+	void addInput(const string& path, const string& output_dir);
+};
@@ -111,7 +111,7 @@ bool Device::setup(string oni_file_path)
 	
 	oni_file_path = ofToDataPath(oni_file_path);
 	
-	assert_error(device.open(oni_file_path.c_str()));
+	if (!check_error(device.open(oni_file_path.c_str()))) return false;
 	check_error(device.setDepthColorSyncEnabled(true));
 	
 	return true;
@@ -123,10 +123,9 @@ void Device::exit()
 	
 	stopRecord();
 	
-	for (int i = 0; i < streams.size(); i++)
-		streams[i]->exit();
-	
-	streams.clear();
+	// each exit() removes the stream from the list
+	while (!streams.empty())
+		streams.back()->exit();
 }
 
 void Device::update()
@@ -134,7 +133,9 @@ void Device::update()
 	for (int i = 0; i < streams.size(); i++)
 	{
 		Stream *s = streams[i];
-		s->is_frame_new = s->openni_timestamp != s->opengl_timestamp;
+		const unsigned int count = s->openni_frame_count;
+		s->is_frame_new = count != s->opengl_frame_count;
+		s->opengl_frame_count = count;
 		s->opengl_timestamp = s->openni_timestamp;
 	}
 	
@@ -192,15 +193,77 @@ void Device::stopRecord()
 	recorder = NULL;
 }
 
+bool Device::setPlaybackSpeed(float speed)
+{
+	openni::PlaybackControl *playback = device.getPlaybackControl();
+	if (!playback) return false;
+	
+	return check_error(playback->setSpeed(speed));
+}
+
+float Device::getPlaybackSpeed() const
+{
+	const openni::PlaybackControl *playback = const_cast<openni::Device&>(device).getPlaybackControl();
+	return playback ? playback->getSpeed() : 0;
+}
+
+bool Device::setPlaybackRepeat(bool v)
+{
+	openni::PlaybackControl *playback = device.getPlaybackControl();
+	if (!playback) return false;
+	
+	return check_error(playback->setRepeatEnabled(v));
+}
+
+bool Device::getPlaybackRepeat() const
+{
+	const openni::PlaybackControl *playback = const_cast<openni::Device&>(device).getPlaybackControl();
+	return playback ? playback->getRepeatEnabled() : false;
+}
+
+int Device::getNumFrames(const Stream &stream) const
+{
+	const openni::PlaybackControl *playback = const_cast<openni::Device&>(device).getPlaybackControl();
+	return playback ? playback->getNumberOfFrames(stream.get()) : 0;
+}
+
+bool Device::seek(Stream &stream, int frame_index)
+{
+	openni::PlaybackControl *playback = device.getPlaybackControl();
+	if (!playback) return false;
+	
+	// .oni frame ids run from 1 to the number of frames
+	const int num_frames = playback->getNumberOfFrames(stream.get());
+	frame_index = ofClamp(frame_index, 1, std::max(num_frames, 1));
+	return check_error(playback->seek(stream.get(), frame_index));
+}
+
+bool Device::seekToTimestamp(Stream &stream, uint64_t timestamp)
+{
+	const int fps = stream.getFps();
+	if (fps <= 0) return false;
+	
+	const double frames = ((double)timestamp - (double)stream.getTimestamp()) * fps / 1000000.0;
+	return seek(stream, stream.getFrameIndex() + (int)floor(frames + 0.5));
+}
+
+bool Device::step(Stream &stream, int frames)
+{
+	return seek(stream, stream.getFrameIndex() + frames);
+}
+
 #pragma mark - Stream
 
-Stream::Stream() {}
+Stream::Stream() : device(NULL) {}
 Stream::~Stream() {}
 
 bool Stream::setup(ofxNI2::Device &device, openni::SensorType sensor_type)
 {
 	openni_timestamp = 0;
 	opengl_timestamp = 0;
+	frame_index = 0;
+	openni_frame_count = 0;
+	opengl_frame_count = 0;
 	
 	check_error(stream.create(device, sensor_type));
 	if (!stream.isValid()) return false;
@@ -210,40 +273,90 @@ bool Stream::setup(ofxNI2::Device &device, openni::SensorType sensor_type)
 	
 	setMirror(false);
 	
+	intrinsics.setup(stream);
+	
 	stream.addNewFrameListener(this);
 	
 	return true;
 }
 
+bool Stream::setupReplay(ofxNI2::Device &device, const openni::VideoMode &mode, const Intrinsics &intrinsics)
+{
+	openni_timestamp = 0;
+	opengl_timestamp = 0;
+	frame_index = 0;
+	openni_frame_count = 0;
+	opengl_frame_count = 0;
+	
+	device.streams.push_back(this);
+	this->device = &device;
+	
+	replay_mode = mode;
+	this->intrinsics = intrinsics;
+	
+	return true;
+}
+
 void Stream::exit()
 {
-	if (!stream.isValid()) return;
+	if (device)
+	{
+		device->streams.erase(remove(device->streams.begin(),
+									 device->streams.end(), this),
+							  device->streams.end());
+		device = NULL;
+	}
 
-	device->streams.erase(remove(device->streams.begin(),
-								 device->streams.end(), this),
-						  device->streams.end());
+	if (!stream.isValid()) return;
 
 	stream.stop();
 	stream.destroy();
 }
 
-void Stream::start()
+bool Stream::start()
 {
-	if (stream.isValid())
-	{
-		assert_error(stream.start());
-	}
+	if (!stream.isValid()) return false;
+	return check_error(stream.start());
 }
 
 void Stream::onNewFrame(openni::VideoStream&)
 {
 	openni::VideoFrameRef frame;
 	check_error(stream.readFrame(&frame));
+	processFrame(Frame(frame));
+}
+
+void Stream::processFrame(const Frame &frame)
+{
 	setPixels(frame);
 	
-	openni_timestamp = frame.getTimestamp();
+	openni_timestamp = frame.timestamp;
+	frame_index = frame.frame_index;
+	openni_frame_count++;
 	
 	texture_needs_update = true;
+	
+	frame_listener_mutex.lock();
+	for (int i = 0; i < frame_listeners.size(); i++)
+		frame_listeners[i]->onNewFrame(*this, frame);
+	frame_listener_mutex.unlock();
+}
+
+void Stream::addFrameListener(FrameListener *listener)
+{
+	ofScopedLock lock(frame_listener_mutex);
+	
+	if (find(frame_listeners.begin(), frame_listeners.end(), listener) == frame_listeners.end())
+		frame_listeners.push_back(listener);
+}
+
+void Stream::removeFrameListener(FrameListener *listener)
+{
+	ofScopedLock lock(frame_listener_mutex);
+	
+	vector<FrameListener*>::iterator it = find(frame_listeners.begin(), frame_listeners.end(), listener);
+	if (it != frame_listeners.end())
+		frame_listeners.erase(it);
 }
 
 bool Stream::setSize(int width, int height)
@@ -254,6 +367,7 @@ bool Stream::setSize(int width, int height)
 	
 	if (rc == openni::STATUS_OK)
 	{
+		intrinsics.setup(stream);
 		return true;
 	}
 	
@@ -263,12 +377,12 @@ bool Stream::setSize(int width, int height)
 
 int Stream::getWidth() const
 {
-	return stream.getVideoMode().getResolutionX();
+	return getVideoMode().getResolutionX();
 }
 
 int Stream::getHeight() const
 {
-	return stream.getVideoMode().getResolutionY();
+	return getVideoMode().getResolutionY();
 }
 
 bool Stream::setWidth(int v)
@@ -283,7 +397,7 @@ bool Stream::setHeight(int v)
 
 int Stream::getFps()
 {
-	return stream.getVideoMode().getFps();
+	return getVideoMode().getFps();
 }
 
 bool Stream::setFps(int v)
@@ -311,9 +425,9 @@ bool Stream::getMirror()
 	return stream.getMirroringEnabled();
 }
 
-void Stream::setPixels(openni::VideoFrameRef frame)
+void Stream::setPixels(const Frame &frame)
 {
-	openni_timestamp = frame.getTimestamp();
+	openni_timestamp = frame.timestamp;
 }
 
 void Stream::updateTextureIfNeeded()
@@ -338,11 +452,11 @@ void Stream::draw(float x, float y, float w, float h)
 
 #pragma mark - IrStream
 
-void IrStream::setPixels(openni::VideoFrameRef frame)
+void IrStream::setPixels(const Frame &frame)
 {
 	Stream::setPixels(frame);
 	
-	openni::VideoMode m = frame.getVideoMode();
+	const openni::VideoMode &m = frame.video_mode;
 	
 	int w = m.getResolutionX();
 	int h = m.getResolutionY();
@@ -352,7 +466,7 @@ void IrStream::setPixels(openni::VideoFrameRef frame)
 
 	if (m.getPixelFormat() == openni::PIXEL_FORMAT_GRAY8)
 	{
-		const unsigned char *src = (const unsigned char*)frame.getData();
+		const unsigned char *src = (const unsigned char*)frame.data;
 		unsigned char *dst = pix.getBackBuffer().getPixels();
 
 		for (int i = 0; i < num_pixels; i++)
@@ -364,7 +478,7 @@ void IrStream::setPixels(openni::VideoFrameRef frame)
 	}
 	else if (m.getPixelFormat() == openni::PIXEL_FORMAT_GRAY16)
 	{
-		const unsigned short *src = (const unsigned short*)frame.getData();
+		const unsigned short *src = (const unsigned short*)frame.data;
 		unsigned char *dst = pix.getBackBuffer().getPixels();
 
 		for (int i = 0; i < num_pixels; i++)
@@ -393,11 +507,11 @@ void IrStream::updateTextureIfNeeded()
 
 #pragma mark - ColorStream
 
-void ColorStream::setPixels(openni::VideoFrameRef frame)
+void ColorStream::setPixels(const Frame &frame)
 {
 	Stream::setPixels(frame);
 	
-	openni::VideoMode m = frame.getVideoMode();
+	const openni::VideoMode &m = frame.video_mode;
 	
 	int w = m.getResolutionX();
 	int h = m.getResolutionY();
@@ -407,7 +521,7 @@ void ColorStream::setPixels(openni::VideoFrameRef frame)
 	
 	if (m.getPixelFormat() == openni::PIXEL_FORMAT_RGB888)
 	{
-		const unsigned char *src = (const unsigned char*)frame.getData();
+		const unsigned char *src = (const unsigned char*)frame.data;
 		unsigned char *dst = pix.getBackBuffer().getPixels();
 		
 		for (int i = 0; i < num_pixels; i++)
@@ -445,13 +559,13 @@ bool DepthStream::setup(ofxNI2::Device &device)
 	return Stream::setup(device, openni::SENSOR_DEPTH);
 }
 
-void DepthStream::setPixels(openni::VideoFrameRef frame)
+void DepthStream::setPixels(const Frame &frame)
 {
 	Stream::setPixels(frame);
 	
-	const unsigned short *pixels = (const unsigned short*)frame.getData();
-	int w = frame.getVideoMode().getResolutionX();
-	int h = frame.getVideoMode().getResolutionY();
+	const unsigned short *pixels = (const unsigned short*)frame.data;
+	int w = frame.video_mode.getResolutionX();
+	int h = frame.video_mode.getResolutionY();
 	int num_pixels = w * h;
 	
 	pix.allocate(w, h, 1);
@@ -520,6 +634,8 @@ ofVec3f DepthStream::getWorldCoordinateAt(int x, int y)
 	const unsigned short *ptr = pix.getPixels();
 	unsigned short z = ptr[pix.getWidth() * y + x];
 	
+	// kept on OpenNI's converter, getIntrinsics().unproject() is the fast
+	// path and differs in the cases Intrinsics.h lists
 	openni::CoordinateConverter::convertDepthToWorld(stream, x, y, z, &v.x, &v.y, &v.z);
 
 	return v;
@@ -8,6 +8,7 @@
 //#define HAVE_NITE2
 
 #include "utils/DoubleBuffer.h"
+#include "utils/Intrinsics.h"
 
 namespace ofxNI2
 {
@@ -15,6 +16,8 @@ namespace ofxNI2
 	
 	class Device;
 	class Stream;
+	struct Frame;
+	class FrameListener;
 	
 	class IrStream;
 	class ColorStream;
@@ -57,6 +60,35 @@ public:
 	
 	void setDepthColorSyncEnabled(bool b = true) { device.setDepthColorSyncEnabled(b); }
 	
+	// playback, only for devices opened from a file
+	
+	bool isFile() const { return device.isFile(); }
+	
+	// 1 plays at the recorded speed, 0 as fast as frames can be read.
+	// -1 is manual: the next frame comes once the last one was read, so
+	// playback runs as fast as the FrameListeners process
+	bool setPlaybackSpeed(float speed);
+	float getPlaybackSpeed() const;
+	
+	bool setPlaybackRepeat(bool v = true);
+	bool getPlaybackRepeat() const;
+	
+	int getNumFrames(const Stream &stream) const;
+	
+	// frame indices start at 1, like Stream::getFrameIndex(), and are
+	// clamped to 1 .. getNumFrames(). the other streams follow to the
+	// frames recorded with this one
+	bool seek(Stream &stream, int frame_index);
+	
+	// estimated from the current frame and the fps, exact unless frames
+	// were dropped while recording
+	bool seekToTimestamp(Stream &stream, uint64_t timestamp);
+	
+	// relative to the current frame of stream, negative goes back
+	bool step(Stream &stream, int frames = 1);
+	
+	openni::PlaybackControl* getPlaybackControl() { return device.getPlaybackControl(); }
+	
 	operator openni::Device&() { return device; }
 	operator const openni::Device&() const { return device; }
 
@@ -71,11 +103,44 @@ protected:
 	openni::Recorder *recorder;
 };
 
+// a frame as it reaches setPixels() and the FrameListeners. data belongs
+// to whoever delivered the frame and is only valid during the call, copy
+// what has to be kept
+
+struct ofxNI2::Frame
+{
+	const void *data;
+	int data_size;
+	
+	int width, height;
+	int stride; // bytes per row
+	
+	uint64_t timestamp;
+	int frame_index;
+	
+	openni::VideoMode video_mode;
+	
+	Frame() : data(NULL), data_size(0), width(0), height(0), stride(0), timestamp(0), frame_index(0) {}
+	
+	// ref has to outlive the frame
+	explicit Frame(const openni::VideoFrameRef &ref)
+		: data(ref.getData())
+		, data_size(ref.getDataSize())
+		, width(ref.getWidth())
+		, height(ref.getHeight())
+		, stride(ref.getStrideInBytes())
+		, timestamp(ref.getTimestamp())
+		, frame_index(ref.getFrameIndex())
+		, video_mode(ref.getVideoMode())
+	{}
+};
+
 // stream
 
 class ofxNI2::Stream : public openni::VideoStream::NewFrameListener
 {
 	friend class ofxNI2::Device;
+	friend class ReplayHarness;
 	
 public:
 	
@@ -83,7 +148,7 @@ public:
 	
 	void exit();
 	
-	void start();
+	bool start();
 	
 	int getWidth() const;
 	int getHeight() const;
@@ -107,8 +172,17 @@ public:
 	
 	inline float getHorizontalFieldOfView() const { return ofRadToDeg(stream.getHorizontalFieldOfView()); }
 	inline float getVerticalFieldOfView() const { return ofRadToDeg(stream.getVerticalFieldOfView()); }
+	
+	const Intrinsics& getIntrinsics() const { return intrinsics; }
 
 	inline bool isFrameNew() const { return is_frame_new; }
+	
+	// OpenNI timestamp of the latest frame in microseconds
+	inline uint64_t getTimestamp() const { return openni_timestamp; }
+	
+	// frame index of the latest frame, the position in a recording. .oni
+	// files count from 1 to Device::getNumFrames(), 0 before the first frame
+	inline int getFrameIndex() const { return frame_index; }
 
 	void draw(float x = 0, float y = 0);
 	virtual void draw(float x, float y, float w, float h);
@@ -121,21 +195,58 @@ public:
 	openni::VideoStream& get() { return stream; }
 	const openni::VideoStream& get() const { return stream; }
 
+	// listeners are called on the OpenNI capture thread
+	void addFrameListener(FrameListener *listener);
+	void removeFrameListener(FrameListener *listener);
+
 protected:
 
 	openni::VideoStream stream;
+	
+	// stands in for the mode of stream when frames come from ReplayHarness
+	openni::VideoMode replay_mode;
+	
 	uint64_t openni_timestamp, opengl_timestamp;
+	int frame_index;
+	
+	// counts frames, timestamps repeat when playback seeks or loops
+	unsigned int openni_frame_count, opengl_frame_count;
 	bool is_frame_new, texture_needs_update;
 	
+	Intrinsics intrinsics;
+	
+	vector<FrameListener*> frame_listeners;
+	ofMutex frame_listener_mutex;
+	
 	ofTexture tex;
 	Device *device;
 	
 	Stream();
 
 	bool setup(ofxNI2::Device &device, openni::SensorType sensor_type);
-	virtual void setPixels(openni::VideoFrameRef frame);
+	
+	// no openni::VideoStream, frames are passed to processFrame()
+	bool setupReplay(ofxNI2::Device &device, const openni::VideoMode &mode, const Intrinsics &intrinsics);
+	
+	openni::VideoMode getVideoMode() const { return stream.isValid() ? stream.getVideoMode() : replay_mode; }
+	
+	virtual void setPixels(const Frame &frame);
 	
 	void onNewFrame(openni::VideoStream&);
+	
+	// everything a frame goes through after it was read
+	void processFrame(const Frame &frame);
+};
+
+// receives every frame right after the stream has read it, before the main
+// thread sees it. keep the work short or hand it to another thread
+
+class ofxNI2::FrameListener
+{
+public:
+	
+	virtual ~FrameListener() {}
+	virtual void onNewFrame(Stream &stream, const Frame &frame) = 0;
 };
 
 class ofxNI2::IrStream : public ofxNI2::Stream
@@ -154,7 +265,7 @@ public:
 protected:
 
 	DoubleBuffer<ofPixels> pix;
-	void setPixels(openni::VideoFrameRef frame);
+	void setPixels(const Frame &frame);
 
 };
 
@@ -180,7 +291,7 @@ public:
 protected:
 	
 	DoubleBuffer<ofPixels> pix;
-	void setPixels(openni::VideoFrameRef frame);
+	void setPixels(const Frame &frame);
 	
 };
 
@@ -209,7 +320,7 @@ public:
 protected:
 	
 	DoubleBuffer<ofShortPixels> pix;
-	void setPixels(openni::VideoFrameRef frame);
+	void setPixels(const Frame &frame);
 	
 	ofPtr<DepthShader> shader;
 };
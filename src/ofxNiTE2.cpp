@@ -36,13 +36,13 @@ bool UserTracker::setup(ofxNI2::Device &device)
 	mutex = new ofMutex;
 	
 	{
-		// get device FOV for overlay camera;
+		// get device intrinsics for overlay camera;
 		
 		openni::VideoStream stream;
 		stream.create(device, openni::SENSOR_DEPTH);
 		
-		float fov = stream.getVerticalFieldOfView();
-		overlay_camera.setFov(ofRadToDeg(fov));
+		intrinsics.setup(stream);
+		overlay_camera.setFov(intrinsics.getVerticalFieldOfView());
 		overlay_camera.setNearClip(500);
 		
 		stream.destroy();
@@ -127,6 +127,28 @@ void UserTracker::onNewFrame(nite::UserTracker &tracker)
 		pix.getBackBuffer().setFromPixels(pixels, w, h, OF_IMAGE_GRAYSCALE);
 		pix.swap();
 	}
+	
+	frame_listener_mutex.lock();
+	for (int i = 0; i < frame_listeners.size(); i++)
+		frame_listeners[i]->onNewFrame(*this, userTrackerFrame);
+	frame_listener_mutex.unlock();
+}
+
+void UserTracker::addFrameListener(UserFrameListener *listener)
+{
+	ofScopedLock lock(frame_listener_mutex);
+	
+	if (find(frame_listeners.begin(), frame_listeners.end(), listener) == frame_listeners.end())
+		frame_listeners.push_back(listener);
+}
+
+void UserTracker::removeFrameListener(UserFrameListener *listener)
+{
+	ofScopedLock lock(frame_listener_mutex);
+	
+	vector<UserFrameListener*>::iterator it = find(frame_listeners.begin(), frame_listeners.end(), listener);
+	if (it != frame_listeners.end())
+		frame_listeners.erase(it);
 }
 
 ofPixels UserTracker::getPixelsRef(int _near, int _far, bool invert)
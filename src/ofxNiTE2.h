@@ -10,6 +10,7 @@
 namespace ofxNiTE2
 {
 	class UserTracker;
+	class UserFrameListener;
 	class User;
 	class Joint;
 }
@@ -115,11 +116,18 @@ public:
 	
 	inline nite::UserTrackerFrameRef getFrame() const { return userTrackerFrame; }
 	
+	const ofxNI2::Intrinsics& getIntrinsics() const { return intrinsics; }
+	
+	// listeners are called on the NiTE thread
+	void addFrameListener(UserFrameListener *listener);
+	void removeFrameListener(UserFrameListener *listener);
+	
 protected:
 	
 	ofxNI2::DoubleBuffer<ofShortPixels> pix;
 	
 	ofxNI2::Device *device;
+	ofxNI2::Intrinsics intrinsics;
 	
 	nite::UserTracker user_tracker;
 	nite::UserMap user_map;
@@ -134,8 +142,22 @@ protected:
 	ofMutex *mutex;
 	ofCamera overlay_camera;
 	
+	vector<UserFrameListener*> frame_listeners;
+	ofMutex frame_listener_mutex;
+	
 	void onNewFrame(nite::UserTracker &tracker);
 	void onUpdate(ofEventArgs&);
 };
 
+// receives every user tracker frame as soon as NiTE delivers it, like
+// ofxNI2::FrameListener
+
+class ofxNiTE2::UserFrameListener
+{
+public:
+	
+	virtual ~UserFrameListener() {}
+	virtual void onNewFrame(UserTracker &tracker, const nite::UserTrackerFrameRef &frame) = 0;
+};
+
 #endif
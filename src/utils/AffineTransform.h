@@ -0,0 +1,46 @@
+#pragma once
+
+#include "ofMain.h"
+
+namespace ofxNI2
+{
+	struct AffineTransform;
+}
+
+// the affine part of an ofMatrix4x4, unpacked for per point loops.
+// same convention as ofMatrix4x4::preMult() (v * M)
+
+struct ofxNI2::AffineTransform
+{
+public:
+
+	float m00, m01, m02;
+	float m10, m11, m12;
+	float m20, m21, m22;
+	float m30, m31, m32;
+
+	AffineTransform() { set(ofMatrix4x4()); }
+	AffineTransform(const ofMatrix4x4& mat) { set(mat); }
+
+	void set(const ofMatrix4x4& mat)
+	{
+		m00 = mat(0, 0); m01 = mat(0, 1); m02 = mat(0, 2);
+		m10 = mat(1, 0); m11 = mat(1, 1); m12 = mat(1, 2);
+		m20 = mat(2, 0); m21 = mat(2, 1); m22 = mat(2, 2);
+		m30 = mat(3, 0); m31 = mat(3, 1); m32 = mat(3, 2);
+	}
+
+	inline void apply(float x, float y, float z, float &ox, float &oy, float &oz) const
+	{
+		ox = x * m00 + y * m10 + z * m20 + m30;
+		oy = x * m01 + y * m11 + z * m21 + m31;
+		oz = x * m02 + y * m12 + z * m22 + m32;
+	}
+
+	inline ofVec3f apply(const ofVec3f& v) const
+	{
+		ofVec3f o;
+		apply(v.x, v.y, v.z, o.x, o.y, o.z);
+		return o;
+	}
+};
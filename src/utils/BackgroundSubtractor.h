@@ -0,0 +1,334 @@
+#pragma once
+
+#include "ofMain.h"
+#include "utils/Simd.h"
+
+namespace ofxNI2
+{
+	class BackgroundSubtractor;
+}
+
+// learned depth background and foreground masks. works on any depth frame
+// where 0 means no reading, e.g. DepthStream::getPixelsRef() or
+// ofxNiTE2::UserTracker::getPixelsRef().
+//
+// a pixel is foreground when it is nearer than its background by more
+// than base + quadratic * (Z / 1000)^2 raw units, which follows the depth
+// noise of structured light sensors. the per pixel threshold depth is
+// kept in an image, so the test itself is one vector compare.
+//
+// the result comes as an 8bit mask (255 = foreground) and as packed rows
+// of 32bit words, getPackedStride() words per row, bit x & 31 of word
+// x / 32 for column x.
+
+class ofxNI2::BackgroundSubtractor
+{
+public:
+
+	enum Model
+	{
+		MIN,
+		MEDIAN
+	};
+
+	BackgroundSubtractor() : width(0), height(0), model(MEDIAN), learn_frames(0), learned_frames(0), tolerance_base(20), tolerance_quadratic(10), foreground_without_background(true), adaptation_interval(0), frame_count(0), packed_stride(0)
+	{
+		// 8 mask bits -> 8 bytes of 0 or 255
+		for (int i = 0; i < 256; i++)
+			for (int b = 0; b < 8; b++)
+				expand[i][b] = (i >> b) & 1 ? 255 : 0;
+	}
+
+	// the next num_frames frames build the background, replacing the old one
+	void learn(int num_frames = 30, Model m = MEDIAN)
+	{
+		model = m;
+		learn_frames = std::max(num_frames, 1);
+		learned_frames = 0;
+
+		if (width > 0) startLearning();
+	}
+
+	bool isLearning() const { return learned_frames < learn_frames; }
+
+	const ofPixels& update(const ofShortPixels& depth)
+	{
+		assert(depth.getNumChannels() == 1);
+
+		if (depth.getWidth() != width || depth.getHeight() != height)
+			allocate(depth.getWidth(), depth.getHeight());
+
+		const unsigned short *src = depth.getPixels();
+
+		if (isLearning())
+		{
+			learnFrame(src);
+			mask.set(0);
+			std::fill(packed.begin(), packed.end(), 0);
+			return mask;
+		}
+
+		frame_count++;
+
+		const bool adapt = adaptation_interval > 0 && frame_count % adaptation_interval == 0;
+
+		for (int y = 0; y < height; y++)
+		{
+			subtractRow(y, src + y * width);
+			if (adapt) adaptRow(y, src + y * width);
+		}
+
+		return mask;
+	}
+
+	const ofPixels& getMask() const { return mask; }
+
+	const vector<uint32_t>& getPackedMask() const { return packed; }
+	int getPackedStride() const { return packed_stride; }
+
+	// editable, call updateThreshold() after changes
+	ofShortPixels& getBackground() { return background; }
+
+	void updateThreshold()
+	{
+		buildLut();
+
+		const unsigned short *bg = background.getPixels();
+		for (int i = 0; i < width * height; i++)
+			threshold[i] = toThreshold(bg[i]);
+	}
+
+	// raw depth units, quadratic is per square meter of millimeter depth
+	void setTolerance(float base, float quadratic = 0)
+	{
+		tolerance_base = base;
+		tolerance_quadratic = quadratic;
+		if (width > 0) updateThreshold();
+	}
+	float getToleranceBase() const { return tolerance_base; }
+	float getToleranceQuadratic() const { return tolerance_quadratic; }
+
+	// what happens to depth where the background never had any
+	void setForegroundWithoutBackground(bool v) { foreground_without_background = v; if (width > 0) updateThreshold(); }
+	bool getForegroundWithoutBackground() const { return foreground_without_background; }
+
+	// background pixels move one raw unit towards the current depth every
+	// this many frames, 0 disables
+	void setAdaptationInterval(int frames) { adaptation_interval = std::max(frames, 0); }
+	int getAdaptationInterval() const { return adaptation_interval; }
+
+protected:
+
+	typedef simd::Vec<unsigned short> V;
+
+	enum { LANES = V::WIDTH };
+
+	int width, height;
+
+	Model model;
+	int learn_frames, learned_frames;
+
+	float tolerance_base, tolerance_quadratic;
+	bool foreground_without_background;
+
+	int adaptation_interval;
+	unsigned int frame_count;
+
+	ofShortPixels background;
+
+	// depth below which a pixel is foreground
+	vector<unsigned short> threshold;
+	vector<unsigned short> tolerance_lut;
+
+	// pixel major samples for the median model, laid out like TileHistory:
+	// tiles of LANES pixels with all learned frames of a tile together
+	vector<unsigned short> samples;
+
+	ofPixels mask;
+	vector<uint32_t> packed;
+	int packed_stride;
+
+	unsigned char expand[256][8];
+
+	void allocate(int w, int h)
+	{
+		width = w;
+		height = h;
+
+		background.allocate(w, h, 1);
+		background.set(0);
+
+		threshold.assign(w * h, 0);
+
+		mask.allocate(w, h, 1);
+		mask.set(0);
+
+		packed_stride = (w + 31) / 32;
+		packed.assign(packed_stride * h, 0);
+
+		if (isLearning()) startLearning();
+
+		updateThreshold();
+	}
+
+	void startLearning()
+	{
+		background.set(0);
+
+		if (model == MEDIAN)
+			samples.assign(getNumTiles() * learn_frames * LANES, 0);
+	}
+
+	void learnFrame(const unsigned short *src)
+	{
+		const int N = width * height;
+
+		if (model == MEDIAN)
+		{
+			const int num_tiles = getNumTiles();
+
+			for (int t = 0; t < num_tiles; t++)
+			{
+				unsigned short *tile = &samples[(t * learn_frames + learned_frames) * LANES];
+				memcpy(tile, src + t * LANES, std::min((int)LANES, N - t * LANES) * sizeof(unsigned short));
+			}
+		}
+		else
+		{
+			// min of the valid values: 0 wraps around to the largest value
+			unsigned short *bg = background.getPixels();
+
+			const V minus_one = V::set1(0xFFFF);
+			const V one = V::set1(1);
+
+			int i = 0;
+			for (; i + V::WIDTH <= N; i += V::WIDTH)
+			{
+				const V a = simd::add(V::load(bg + i), minus_one);
+				const V b = simd::add(V::load(src + i), minus_one);
+				simd::add(simd::min(a, b), one).store(bg + i);
+			}
+
+			for (; i < N; i++)
+				bg[i] = std::min((unsigned short)(bg[i] - 1), (unsigned short)(src[i] - 1)) + 1;
+		}
+
+		learned_frames++;
+
+		if (!isLearning())
+		{
+			if (model == MEDIAN) finishMedian();
+			updateThreshold();
+		}
+	}
+
+	void finishMedian()
+	{
+		const int N = width * height;
+		unsigned short *bg = background.getPixels();
+
+		const int num_tiles = getNumTiles();
+
+		vector<unsigned short> v(learn_frames);
+
+		for (int t = 0; t < num_tiles; t++)
+		{
+			const unsigned short *tile = &samples[t * learn_frames * LANES];
+			const int size = std::min((int)LANES, N - t * LANES);
+
+			for (int l = 0; l < size; l++)
+			{
+				int n = 0;
+				for (int f = 0; f < learn_frames; f++)
+				{
+					const unsigned short d = tile[f * LANES + l];
+					if (d) v[n++] = d;
+				}
+
+				const int i = t * LANES + l;
+
+				if (n == 0)
+				{
+					bg[i] = 0;
+					continue;
+				}
+
+				std::nth_element(v.begin(), v.begin() + n / 2, v.begin() + n);
+				bg[i] = v[n / 2];
+			}
+		}
+
+		vector<unsigned short>().swap(samples);
+	}
+
+	int getNumTiles() const { return (width * height + LANES - 1) / LANES; }
+
+	void buildLut()
+	{
+		tolerance_lut.resize(65536);
+
+		for (int z = 0; z < 65536; z++)
+		{
+			const float m = z * 0.001;
+			tolerance_lut[z] = ofClamp(tolerance_base + tolerance_quadratic * m * m, 0, 65535);
+		}
+	}
+
+	inline unsigned short toThreshold(unsigned short bg) const
+	{
+		if (bg == 0) return foreground_without_background ? 0xFFFF : 0;
+
+		const int t = bg - tolerance_lut[bg];
+		return t > 0 ? t : 0;
+	}
+
+	void subtractRow(int y, const unsigned short *src)
+	{
+		const unsigned short *thr = &threshold[y * width];
+		unsigned char *dst = mask.getPixels() + y * width;
+		uint32_t *bits = &packed[y * packed_stride];
+
+		std::fill(bits, bits + packed_stride, 0);
+
+		const V zero = V::set1(0);
+
+		int x = 0;
+
+		for (; x + V::WIDTH <= width; x += V::WIDTH)
+		{
+			const V d = V::load(src + x);
+
+			// d != 0 && d < thr
+			const V below = simd::eq(simd::subs(V::load(thr + x), d), zero);
+			const V none = simd::eq(d, zero);
+			const int m = ~simd::movemask(simd::bitOr(below, none)) & 0xFF;
+
+			memcpy(dst + x, expand[m], 8);
+			bits[x >> 5] |= (uint32_t)m << (x & 31);
+		}
+
+		for (; x < width; x++)
+		{
+			const bool fg = src[x] != 0 && src[x] < thr[x];
+
+			dst[x] = fg ? 255 : 0;
+			if (fg) bits[x >> 5] |= 1u << (x & 31);
+		}
+	}
+
+	// runs after subtractRow, so the mask of this frame is known
+	void adaptRow(int y, const unsigned short *src)
+	{
+		unsigned short *bg = background.getPixels() + y * width;
+		unsigned short *thr = &threshold[y * width];
+		const unsigned char *fg = mask.getPixels() + y * width;
+
+		for (int x = 0; x < width; x++)
+		{
+			if (fg[x] || src[x] == 0 || bg[x] == 0 || src[x] == bg[x]) continue;
+
+			bg[x] += src[x] > bg[x] ? 1 : -1;
+			thr[x] = toThreshold(bg[x]);
+		}
+	}
+};
@@ -0,0 +1,421 @@
+#pragma once
+
+#include "ofxNI2.h"
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+namespace ofxNI2
+{
+	class ConnectedComponents;
+}
+
+// blob labelling for foreground masks, e.g. from BackgroundSubtractor.
+//
+// each mask row is run length encoded, runs touching a run of the previous
+// row are merged with union-find, and statistics are summed per run while
+// encoding, so the pixels are only read once. with depth, blobs also get
+// the mean raw depth and the world centroid (OpenNI world, like
+// Intrinsics::unproject) of their pixels with depth.
+//
+// blobs are sorted by area, largest first.
+
+class ofxNI2::ConnectedComponents
+{
+public:
+
+	struct Blob
+	{
+		int area;
+		ofRectangle bounding_box;
+		ofVec2f centroid;
+
+		// over the pixels with depth, 0 if there are none
+		int num_depth_samples;
+		float mean_depth;
+		ofVec3f world_centroid;
+	};
+
+	ConnectedComponents() : connectivity(8), min_area(1), compute_labels(false), width(0), height(0), depth_pix(NULL) {}
+
+	void setup(DepthStream& depth_stream)
+	{
+		setup(depth_stream.getIntrinsics());
+	}
+
+	void setup(const Intrinsics& intrinsics)
+	{
+		this->intrinsics = intrinsics;
+	}
+
+	// nonzero mask pixels are foreground. depth is optional
+	const vector<Blob>& update(const ofPixels& mask, const ofShortPixels& depth = ofShortPixels())
+	{
+		assert(mask.getNumChannels() == 1);
+
+		begin(mask.getWidth(), mask.getHeight(), depth);
+
+		for (int y = 0; y < height; y++)
+			encodeRow(y, mask.getPixels() + y * width);
+
+		end();
+		return blobs;
+	}
+
+	// packed rows as from BackgroundSubtractor::getPackedMask()
+	const vector<Blob>& update(const vector<uint32_t>& packed, int stride, int w, int h, const ofShortPixels& depth = ofShortPixels())
+	{
+		assert(packed.size() >= stride * h);
+
+		begin(w, h, depth);
+
+		for (int y = 0; y < height; y++)
+			encodeRow(y, &packed[y * stride]);
+
+		end();
+		return blobs;
+	}
+
+	const vector<Blob>& getBlobs() const { return blobs; }
+
+	// blob index + 1 per pixel, 0 for background. only with setComputeLabels()
+	const ofShortPixels& getLabels() const { return labels; }
+
+	void setConnectivity(int v) { connectivity = v == 4 ? 4 : 8; }
+	int getConnectivity() const { return connectivity; }
+
+	// smaller blobs are dropped, in pixels
+	void setMinArea(int v) { min_area = std::max(v, 1); }
+	int getMinArea() const { return min_area; }
+
+	void setComputeLabels(bool v = true) { compute_labels = v; }
+	bool getComputeLabels() const { return compute_labels; }
+
+protected:
+
+	struct Run
+	{
+		int x0, x1, y;
+		int parent;
+	};
+
+	struct Sum
+	{
+		int area;
+		int x0, y0, x1, y1;
+		double x, y;
+		int num_depth;
+		double z, xz, yz;
+		int root;
+	};
+
+	int connectivity;
+	int min_area;
+	bool compute_labels;
+
+	Intrinsics intrinsics;
+
+	int width, height;
+	const unsigned short *depth_pix;
+
+	vector<Run> runs;
+	vector<Sum> sums;
+	vector<int> row_start;
+
+	// root run -> blob, -1 if dropped
+	vector<int> blob_index;
+	vector<int> order;
+
+	vector<Blob> blobs;
+	ofShortPixels labels;
+
+	void begin(int w, int h, const ofShortPixels& depth)
+	{
+		width = w;
+		height = h;
+
+		depth_pix = NULL;
+		if (depth.isAllocated() && depth.getWidth() == w && depth.getHeight() == h)
+			depth_pix = depth.getPixels();
+
+		if (depth_pix
+			&& intrinsics.isValid()
+			&& (intrinsics.width != w || intrinsics.height != h))
+			intrinsics = intrinsics.getScaled(w, h);
+
+		runs.clear();
+		sums.clear();
+		row_start.resize(h + 1);
+	}
+
+	static inline int ctz(uint32_t v)
+	{
+#ifdef _MSC_VER
+		unsigned long i;
+		_BitScanForward(&i, v);
+		return i;
+#else
+		return __builtin_ctz(v);
+#endif
+	}
+
+	// first column >= x whose bit equals value, or width
+	inline int findBit(const uint32_t *row, int x, bool value) const
+	{
+		while (x < width)
+		{
+			uint32_t word = row[x >> 5];
+			if (!value) word = ~word;
+
+			word &= 0xFFFFFFFFu << (x & 31);
+
+			if (word) return std::min((x & ~31) + ctz(word), width);
+
+			x = (x & ~31) + 32;
+		}
+
+		return width;
+	}
+
+	void encodeRow(int y, const uint32_t *row)
+	{
+		row_start[y] = runs.size();
+
+		int x = findBit(row, 0, true);
+
+		while (x < width)
+		{
+			const int x1 = findBit(row, x, false);
+			addRun(y, x, x1);
+			x = findBit(row, x1, true);
+		}
+
+		linkRow(y);
+	}
+
+	void encodeRow(int y, const unsigned char *row)
+	{
+		row_start[y] = runs.size();
+
+		int x = 0;
+
+		while (x < width)
+		{
+			// skip empty stretches 8 pixels at a time
+			while (x + 8 <= width)
+			{
+				uint64_t v;
+				memcpy(&v, row + x, 8);
+				if (v) break;
+				x += 8;
+			}
+
+			while (x < width && row[x] == 0) x++;
+			if (x >= width) break;
+
+			const int x0 = x;
+			while (x < width && row[x] != 0) x++;
+
+			addRun(y, x0, x);
+		}
+
+		linkRow(y);
+	}
+
+	void addRun(int y, int x0, int x1)
+	{
+		Run r;
+		r.x0 = x0;
+		r.x1 = x1;
+		r.y = y;
+		r.parent = runs.size();
+		runs.push_back(r);
+
+		const int len = x1 - x0;
+
+		Sum s;
+		s.area = len;
+		s.x0 = x0;
+		s.x1 = x1 - 1;
+		s.y0 = s.y1 = y;
+		s.x = len * (x0 + x1 - 1) * 0.5;
+		s.y = (double)len * y;
+		s.num_depth = 0;
+		s.z = s.xz = s.yz = 0;
+
+		if (depth_pix)
+		{
+			const unsigned short *d = depth_pix + y * width;
+
+			int n = 0;
+			unsigned int z = 0;
+			uint64_t xz = 0;
+
+			for (int x = x0; x < x1; x++)
+			{
+				n += d[x] != 0;
+				z += d[x];
+				xz += (uint64_t)x * d[x];
+			}
+
+			s.num_depth = n;
+			s.z = z;
+			s.xz = xz;
+			s.yz = (double)y * z;
+		}
+
+		sums.push_back(s);
+	}
+
+	inline int find(int i)
+	{
+		while (runs[i].parent != i)
+		{
+			runs[i].parent = runs[runs[i].parent].parent;
+			i = runs[i].parent;
+		}
+		return i;
+	}
+
+	inline void unite(int a, int b)
+	{
+		a = find(a);
+		b = find(b);
+
+		if (a < b) runs[b].parent = a;
+		else if (b < a) runs[a].parent = b;
+	}
+
+	// merges the runs of row y with the touching runs of row y - 1
+	void linkRow(int y)
+	{
+		row_start[y + 1] = runs.size();
+
+		if (y == 0) return;
+
+		// diagonal neighbours touch with 8-connectivity
+		const int slack = connectivity == 8 ? 1 : 0;
+
+		int i = row_start[y - 1];
+		const int i_end = row_start[y];
+
+		for (int j = row_start[y]; j < row_start[y + 1]; j++)
+		{
+			const Run &r = runs[j];
+
+			// skip runs of the previous row that end left of this one
+			while (i < i_end && runs[i].x1 + slack <= r.x0) i++;
+
+			for (int k = i; k < i_end && runs[k].x0 < r.x1 + slack; k++)
+				unite(j, k);
+		}
+	}
+
+	void end()
+	{
+		const int N = runs.size();
+
+		// roots have the smallest index of their blob, so they come first
+		for (int i = 0; i < N; i++)
+		{
+			const int root = find(i);
+			sums[i].root = root;
+
+			if (root == i) continue;
+
+			Sum &dst = sums[root];
+			const Sum &src = sums[i];
+
+			dst.area += src.area;
+			dst.x0 = std::min(dst.x0, src.x0);
+			dst.x1 = std::max(dst.x1, src.x1);
+			dst.y0 = std::min(dst.y0, src.y0);
+			dst.y1 = std::max(dst.y1, src.y1);
+			dst.x += src.x;
+			dst.y += src.y;
+			dst.num_depth += src.num_depth;
+			dst.z += src.z;
+			dst.xz += src.xz;
+			dst.yz += src.yz;
+		}
+
+		order.clear();
+		for (int i = 0; i < N; i++)
+			if (sums[i].root == i && sums[i].area >= min_area)
+				order.push_back(i);
+
+		std::sort(order.begin(), order.end(), AreaGreater(sums));
+
+		blobs.resize(order.size());
+		blob_index.assign(N, -1);
+
+		for (int b = 0; b < order.size(); b++)
+		{
+			const int root = order[b];
+			const Sum &s = sums[root];
+
+			blob_index[root] = b;
+
+			Blob &blob = blobs[b];
+			blob.area = s.area;
+			blob.bounding_box.set(s.x0, s.y0, s.x1 - s.x0 + 1, s.y1 - s.y0 + 1);
+			blob.centroid.set(s.x / s.area, s.y / s.area);
+			blob.num_depth_samples = s.num_depth;
+			blob.mean_depth = 0;
+			blob.world_centroid.set(0, 0, 0);
+		}
+
+		if (depth_pix) worldCentroids();
+		if (compute_labels) writeLabels();
+	}
+
+	// the mean of Intrinsics::unproject() over the blob, from its sums
+	void worldCentroids()
+	{
+		for (int b = 0; b < blobs.size(); b++)
+		{
+			Blob &blob = blobs[b];
+			if (blob.num_depth_samples == 0) continue;
+
+			const Sum &s = sums[order[b]];
+			const double n = s.num_depth;
+
+			blob.mean_depth = s.z / n;
+
+			if (!intrinsics.isValid()) continue;
+
+			const double unit = intrinsics.depth_unit;
+
+			blob.world_centroid.set((s.xz - intrinsics.cx * s.z) * intrinsics.inv_fx * unit / n,
+									(intrinsics.cy * s.z - s.yz) * intrinsics.inv_fy * unit / n,
+									s.z * unit / n);
+		}
+	}
+
+	void writeLabels()
+	{
+		if (labels.getWidth() != width || labels.getHeight() != height)
+			labels.allocate(width, height, 1);
+
+		labels.set(0);
+
+		unsigned short *dst = labels.getPixels();
+
+		for (int i = 0; i < runs.size(); i++)
+		{
+			const int b = blob_index[sums[i].root];
+			if (b < 0) continue;
+
+			const Run &r = runs[i];
+			std::fill(dst + r.y * width + r.x0, dst + r.y * width + r.x1, (unsigned short)std::min(b + 1, 65535));
+		}
+	}
+
+	struct AreaGreater
+	{
+		const vector<Sum> &sums;
+		AreaGreater(const vector<Sum> &sums) : sums(sums) {}
+		bool operator()(int a, int b) const { return sums[a].area > sums[b].area; }
+	};
+};
@@ -0,0 +1,329 @@
+#pragma once
+
+#include "ofMain.h"
+#include "utils/WorkerPool.h"
+
+namespace ofxNI2
+{
+	class DepthHoleFiller;
+}
+
+// fills pixels without depth (0), both modes run in linear time.
+//
+// DIRECTIONAL fills each horizontal gap from the farther of its two ends,
+// then the vertical gaps that are left. structured light shadows sit next
+// to the near object, so the farther end is usually the right surface.
+// gaps touching the frame border are not filled.
+//
+// PUSH_PULL builds a pyramid of valid means and pulls coarse values back
+// into the holes, which gives smooth fills for holes of any shape.
+//
+// DIRECTIONAL leaves gaps longer than getMaxHoleSize() as they are. for
+// PUSH_PULL the size only sets the pyramid depth, values reach about that
+// far into a hole, so larger holes are filled along their borders and
+// stay empty in the middle.
+
+class ofxNI2::DepthHoleFiller
+{
+public:
+
+	enum Mode
+	{
+		DIRECTIONAL,
+		PUSH_PULL
+	};
+
+	DepthHoleFiller() : mode(DIRECTIONAL), max_hole_size(16), pool(NULL), width(0), height(0), depth_pix(NULL), num_levels(0), level(0) {}
+
+	const ofShortPixels& update(const ofShortPixels& depth)
+	{
+		assert(depth.getNumChannels() == 1);
+
+		width = depth.getWidth();
+		height = depth.getHeight();
+		depth_pix = depth.getPixels();
+
+		if (!result.isAllocated()
+			|| result.getWidth() != width
+			|| result.getHeight() != height)
+		{
+			result.allocate(width, height, 1);
+		}
+
+		WorkerPool &p = pool ? *pool : WorkerPool::getShared();
+
+		Task task;
+		task.self = this;
+
+		if (mode == DIRECTIONAL)
+		{
+			last_valid.resize(width);
+
+			task.phase = FILL_ROWS;
+			p.run(task, 0, height, ROWS_PER_TASK);
+
+			task.phase = FILL_COLUMNS;
+			p.run(task, 0, width, COLUMNS_PER_TASK);
+		}
+		else
+		{
+			allocatePyramid();
+
+			if (num_levels == 0)
+			{
+				memcpy(result.getPixels(), depth_pix, sizeof(unsigned short) * width * height);
+				return result;
+			}
+
+			task.phase = PUSH;
+			for (level = 0; level < num_levels; level++)
+				p.run(task, 0, levels[level + 1].height, ROWS_PER_TASK);
+
+			task.phase = PULL;
+			for (level = num_levels - 1; level >= 0; level--)
+				p.run(task, 0, levels[level].height, ROWS_PER_TASK);
+		}
+
+		return result;
+	}
+
+	const ofShortPixels& getPixels() const { return result; }
+
+	void setMode(Mode m) { mode = m; }
+	Mode getMode() const { return mode; }
+
+	// in pixels. 0 disables filling
+	void setMaxHoleSize(int v) { max_hole_size = ofClamp(v, 0, 4096); }
+	int getMaxHoleSize() const { return max_hole_size; }
+
+	// NULL uses WorkerPool::getShared()
+	void setWorkerPool(WorkerPool *p) { pool = p; }
+
+protected:
+
+	enum Phase
+	{
+		FILL_ROWS,
+		FILL_COLUMNS,
+		PUSH,
+		PULL
+	};
+
+	class Task : public ParallelTask
+	{
+	public:
+
+		DepthHoleFiller *self;
+		Phase phase;
+
+		void run(int begin, int end)
+		{
+			switch (phase)
+			{
+				case FILL_ROWS: self->fillRows(begin, end); break;
+				case FILL_COLUMNS: self->fillColumns(begin, end); break;
+				case PUSH: self->push(begin, end); break;
+				case PULL: self->pull(begin, end); break;
+			}
+		}
+	};
+
+	enum
+	{
+		ROWS_PER_TASK = 16,
+		COLUMNS_PER_TASK = 64
+	};
+
+	struct Level
+	{
+		int width, height;
+		int offset;
+	};
+
+	Mode mode;
+	int max_hole_size;
+
+	WorkerPool *pool;
+
+	int width, height;
+	const unsigned short *depth_pix;
+
+	ofShortPixels result;
+
+	// directional: row of the last valid pixel in each column
+	vector<int> last_valid;
+
+	// push-pull: every level lives in one allocation, 0 means empty
+	vector<Level> levels;
+	vector<float> pyramid;
+	int num_levels;
+	int level;
+
+	void fillRows(int y0, int y1)
+	{
+		for (int y = y0; y < y1; y++)
+		{
+			const unsigned short *src = depth_pix + y * width;
+			unsigned short *dst = result.getPixels() + y * width;
+
+			memcpy(dst, src, sizeof(unsigned short) * width);
+
+			int last = -1;
+
+			for (int x = 0; x < width; x++)
+			{
+				if (src[x] == 0) continue;
+
+				const int gap = x - last - 1;
+
+				if (last >= 0 && gap > 0 && gap <= max_hole_size)
+				{
+					const unsigned short v = std::max(src[last], src[x]);
+					std::fill(dst + last + 1, dst + x, v);
+				}
+
+				last = x;
+			}
+		}
+	}
+
+	// walks rows in order with one open gap per column, so the inner loop
+	// stays contiguous
+	void fillColumns(int x0, int x1)
+	{
+		unsigned short *dst = result.getPixels();
+
+		for (int x = x0; x < x1; x++)
+			last_valid[x] = -1;
+
+		for (int y = 0; y < height; y++)
+		{
+			const unsigned short *row = dst + y * width;
+
+			for (int x = x0; x < x1; x++)
+			{
+				if (row[x] == 0) continue;
+
+				const int last = last_valid[x];
+				const int gap = y - last - 1;
+
+				if (last >= 0 && gap > 0 && gap <= max_hole_size)
+				{
+					const unsigned short v = std::max(dst[last * width + x], row[x]);
+					for (int yy = last + 1; yy < y; yy++)
+						dst[yy * width + x] = v;
+				}
+
+				last_valid[x] = y;
+			}
+		}
+	}
+
+	// enough levels that a hole of max_hole_size shrinks to one pixel,
+	// ceil(log2(max_hole_size + 1)), so a size of 1 still gets a level
+	void allocatePyramid()
+	{
+		num_levels = 0;
+		while ((1 << num_levels) < max_hole_size + 1) num_levels++;
+
+		levels.resize(num_levels + 1);
+
+		int w = width, h = height, offset = 0;
+
+		for (int i = 0; i <= num_levels; i++)
+		{
+			levels[i].width = w;
+			levels[i].height = h;
+			levels[i].offset = offset;
+
+			offset += w * h;
+			w = (w + 1) / 2;
+			h = (h + 1) / 2;
+		}
+
+		pyramid.resize(offset);
+
+		float *base = &pyramid[0];
+		for (int i = 0; i < width * height; i++)
+			base[i] = depth_pix[i];
+	}
+
+	// level + 1 = mean of the non empty 2x2 children in level
+	void push(int y0, int y1)
+	{
+		const Level &F = levels[level];
+		const Level &C = levels[level + 1];
+
+		const float *fine = &pyramid[F.offset];
+		float *coarse = &pyramid[C.offset];
+
+		for (int y = y0; y < y1; y++)
+		{
+			const float *r0 = fine + (y * 2) * F.width;
+			const float *r1 = fine + std::min(y * 2 + 1, F.height - 1) * F.width;
+
+			float *dst = coarse + y * C.width;
+
+			for (int x = 0; x < C.width; x++)
+			{
+				const int xa = x * 2;
+				const int xb = std::min(xa + 1, F.width - 1);
+
+				const float a = r0[xa], b = r0[xb], c = r1[xa], d = r1[xb];
+				const float n = (a != 0) + (b != 0) + (c != 0) + (d != 0);
+
+				dst[x] = n > 0 ? (a + b + c + d) / n : 0;
+			}
+		}
+	}
+
+	// empty pixels of level take the bilinear (9 3 3 1) mix of the non
+	// empty parents in level + 1. level 0 writes into the result
+	void pull(int y0, int y1)
+	{
+		const Level &F = levels[level];
+		const Level &C = levels[level + 1];
+
+		float *fine = &pyramid[F.offset];
+		const float *coarse = &pyramid[C.offset];
+
+		unsigned short *dst = level == 0 ? result.getPixels() : NULL;
+
+		for (int y = y0; y < y1; y++)
+		{
+			const int py = y / 2;
+			const int qy = ofClamp(py + ((y & 1) ? 1 : -1), 0, C.height - 1);
+
+			const float *p0 = coarse + py * C.width;
+			const float *p1 = coarse + qy * C.width;
+
+			float *row = fine + y * F.width;
+
+			for (int x = 0; x < F.width; x++)
+			{
+				float v = row[x];
+
+				if (v == 0)
+				{
+					const int px = x / 2;
+					const int qx = ofClamp(px + ((x & 1) ? 1 : -1), 0, C.width - 1);
+
+					const float a = p0[px], b = p0[qx], c = p1[px], d = p1[qx];
+					const float wa = a != 0 ? 9 : 0;
+					const float wb = b != 0 ? 3 : 0;
+					const float wc = c != 0 ? 3 : 0;
+					const float wd = d != 0 ? 1 : 0;
+					const float wsum = wa + wb + wc + wd;
+
+					if (wsum > 0)
+					{
+						v = (a * wa + b * wb + c * wc + d * wd) / wsum;
+						row[x] = v;
+					}
+				}
+
+				if (dst) dst[y * F.width + x] = v + 0.5f;
+			}
+		}
+	}
+};
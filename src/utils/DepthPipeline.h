@@ -0,0 +1,327 @@
+#pragma once
+
+#include "ofxNI2.h"
+#include "utils/TripleBuffer.h"
+
+#include "Poco/Event.h"
+
+namespace ofxNI2
+{
+	class DepthStage;
+	class DepthPipeline;
+
+	template <typename Filter>
+	class FilterStage;
+}
+
+// one step of a DepthPipeline. dst is a pipeline owned buffer already
+// allocated like src. a stage either writes into dst and returns it, or
+// returns a buffer of its own (or src itself, e.g. stages that only look
+// at the frame). the returned buffer must stay valid until the next call.
+
+class ofxNI2::DepthStage
+{
+public:
+
+	virtual ~DepthStage() {}
+	virtual const ofShortPixels& process(const ofShortPixels& src, ofShortPixels& dst) = 0;
+};
+
+// wraps any filter with const ofShortPixels& update(const ofShortPixels&),
+// e.g. TimedomainMedianFilter, SpatialDepthFilter or DepthHoleFiller. the
+// filter is not owned and must be set up before frames come in
+
+template <typename Filter>
+class ofxNI2::FilterStage : public ofxNI2::DepthStage
+{
+public:
+
+	FilterStage(Filter &filter) : filter(filter) {}
+
+	const ofShortPixels& process(const ofShortPixels& src, ofShortPixels&)
+	{
+		return filter.update(src);
+	}
+
+protected:
+
+	Filter &filter;
+};
+
+// runs an ordered list of stages on every frame of a DepthStream, either
+// on the capture thread or on a thread of its own. intermediate frames go
+// through two ping-pong buffers, so nothing is allocated per frame once
+// the size is known. results and per-stage timings are published through
+// a TripleBuffer and picked up by update() on the main thread.
+//
+// stages can be added while frames are coming in, but they run on the
+// pipeline thread and must not be touched from elsewhere meanwhile.
+
+class ofxNI2::DepthPipeline : public ofxNI2::FrameListener
+{
+public:
+
+	// CAPTURE_THREAD runs the stages inside the FrameListener call, which
+	// holds the stream's listener mutex: add/removeFrameListener() and the
+	// other listeners of the stream wait for the whole pipeline. use
+	// WORKER_THREAD when the stages are slow or other listeners matter
+	enum Mode
+	{
+		CAPTURE_THREAD,
+		WORKER_THREAD
+	};
+
+	DepthPipeline() : depth_stream(NULL), mode(CAPTURE_THREAD), worker(this), is_frame_new(false), num_dropped(0), frame_number(0) {}
+	~DepthPipeline() { exit(); }
+
+	void setup(DepthStream &stream, Mode m = CAPTURE_THREAD)
+	{
+		exit();
+
+		mode = m;
+
+		if (mode == WORKER_THREAD)
+			worker.startThread(true, false);
+
+		depth_stream = &stream;
+		depth_stream->addFrameListener(this);
+	}
+
+	void exit()
+	{
+		if (depth_stream)
+		{
+			depth_stream->removeFrameListener(this);
+			depth_stream = NULL;
+		}
+
+		if (worker.isThreadRunning())
+		{
+			worker.stopThread();
+			input_ready.set();
+			worker.waitForThread(false);
+		}
+	}
+
+	void addStage(ofPtr<DepthStage> stage, const string& name)
+	{
+		ofScopedLock lock(stage_mutex);
+
+		Stage s;
+		s.stage = stage;
+		s.name = name;
+		s.average_time = 0;
+		stages.push_back(s);
+	}
+
+	template <typename Filter>
+	void addFilter(Filter &filter, const string& name)
+	{
+		addStage(ofPtr<DepthStage>(new FilterStage<Filter>(filter)), name);
+	}
+
+	void clearStages()
+	{
+		ofScopedLock lock(stage_mutex);
+		stages.clear();
+	}
+
+	// main thread side. true if a new result came in since the last call
+	bool update()
+	{
+		is_frame_new = results.update();
+		return is_frame_new;
+	}
+
+	bool isFrameNew() const { return is_frame_new; }
+
+	const ofShortPixels& getPixels() const { return results.getFrontBuffer().pixels; }
+
+	uint64_t getTimestamp() const { return results.getFrontBuffer().timestamp; }
+	unsigned int getFrameNumber() const { return results.getFrontBuffer().frame_number; }
+
+	// timings of the current result in milliseconds
+	int getNumStages() const { return results.getFrontBuffer().timings.size(); }
+	const string& getStageName(int i) const { return results.getFrontBuffer().timings[i].name; }
+	float getStageTime(int i) const { return results.getFrontBuffer().timings[i].time; }
+	float getStageAverageTime(int i) const { return results.getFrontBuffer().timings[i].average_time; }
+	float getTotalTime() const { return results.getFrontBuffer().total_time; }
+
+	// frames the worker skipped because it was still busy
+	unsigned int getNumDropped() const { return num_dropped; }
+
+	// runs the stages on the calling thread and publishes the result, for
+	// frames that don't come from a DepthStream
+	void process(const ofShortPixels& src, uint64_t timestamp = 0)
+	{
+		ofScopedLock lock(stage_mutex);
+
+		Result &out = results.getBackBuffer();
+
+		allocate(out.pixels, src);
+
+		const ofShortPixels *current = &src;
+		const unsigned long long start = ofGetElapsedTimeMicros();
+
+		out.timings.resize(stages.size());
+
+		for (int i = 0; i < stages.size(); i++)
+		{
+			Stage &s = stages[i];
+
+			// the last stage can write straight into the result
+			ofShortPixels *dst;
+			if (i + 1 == stages.size()) dst = &out.pixels;
+			else dst = current == &ping_pong[0] ? &ping_pong[1] : &ping_pong[0];
+
+			allocate(*dst, *current);
+
+			const unsigned long long t = ofGetElapsedTimeMicros();
+			current = &s.stage->process(*current, *dst);
+			const float ms = (ofGetElapsedTimeMicros() - t) / 1000.;
+
+			s.average_time = s.average_time == 0 ? ms : ofLerp(s.average_time, ms, 0.1);
+
+			Timing &timing = out.timings[i];
+			timing.name = s.name;
+			timing.time = ms;
+			timing.average_time = s.average_time;
+		}
+
+		if (current != &out.pixels)
+			copy(out.pixels, current->getPixels(), current->getWidth(), current->getHeight());
+
+		out.total_time = (ofGetElapsedTimeMicros() - start) / 1000.;
+		out.timestamp = timestamp;
+		out.frame_number = frame_number++;
+
+		results.publish();
+	}
+
+protected:
+
+	struct Stage
+	{
+		ofPtr<DepthStage> stage;
+		string name;
+		float average_time;
+	};
+
+	struct Timing
+	{
+		string name;
+		float time, average_time;
+	};
+
+	struct Result
+	{
+		ofShortPixels pixels;
+		uint64_t timestamp;
+		unsigned int frame_number;
+		vector<Timing> timings;
+		float total_time;
+
+		Result() : timestamp(0), frame_number(0), total_time(0) {}
+	};
+
+	struct Input
+	{
+		ofShortPixels pixels;
+		uint64_t timestamp;
+
+		Input() : timestamp(0) {}
+	};
+
+	class Worker : public ofThread
+	{
+	public:
+
+		Worker(DepthPipeline *pipeline) : pipeline(pipeline) {}
+
+	protected:
+
+		DepthPipeline *pipeline;
+
+		void threadedFunction()
+		{
+			while (true)
+			{
+				pipeline->input_ready.wait();
+				if (!isThreadRunning()) break;
+
+				if (pipeline->inputs.update())
+				{
+					const Input &in = pipeline->inputs.getFrontBuffer();
+					pipeline->process(in.pixels, in.timestamp);
+				}
+			}
+		}
+	};
+
+	DepthStream *depth_stream;
+	Mode mode;
+
+	vector<Stage> stages;
+	ofMutex stage_mutex;
+
+	ofShortPixels ping_pong[2];
+
+	// capture thread -> worker
+	TripleBuffer<Input> inputs;
+	Poco::Event input_ready;
+	Worker worker;
+
+	// pipeline thread -> main thread
+	TripleBuffer<Result> results;
+	bool is_frame_new;
+
+	volatile unsigned int num_dropped;
+	unsigned int frame_number;
+
+	// a no-op unless the size changed
+	static void allocate(ofShortPixels& pix, const ofShortPixels& like)
+	{
+		if (pix.getWidth() != like.getWidth()
+			|| pix.getHeight() != like.getHeight()
+			|| pix.getNumChannels() != 1)
+		{
+			pix.allocate(like.getWidth(), like.getHeight(), 1);
+		}
+	}
+
+	static void copy(ofShortPixels& pix, const unsigned short *data, int w, int h)
+	{
+		if (pix.getWidth() != w
+			|| pix.getHeight() != h
+			|| pix.getNumChannels() != 1)
+		{
+			pix.allocate(w, h, 1);
+		}
+
+		memcpy(pix.getPixels(), data, w * h * sizeof(unsigned short));
+	}
+
+	void onNewFrame(Stream&, const Frame &frame)
+	{
+		const int w = frame.video_mode.getResolutionX();
+		const int h = frame.video_mode.getResolutionY();
+		const unsigned short *data = (const unsigned short*)frame.data;
+
+		if (mode == CAPTURE_THREAD)
+		{
+			copy(captured, data, w, h);
+			process(captured, frame.timestamp);
+			return;
+		}
+
+		Input &in = inputs.getBackBuffer();
+		copy(in.pixels, data, w, h);
+		in.timestamp = frame.timestamp;
+
+		if (inputs.publish()) num_dropped++;
+
+		input_ready.set();
+	}
+
+	ofShortPixels captured;
+};
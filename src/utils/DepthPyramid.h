@@ -0,0 +1,281 @@
+#pragma once
+
+#include "ofMain.h"
+#include "utils/Simd.h"
+
+namespace ofxNI2
+{
+	class DepthPyramid;
+}
+
+// 1/2, 1/4, 1/8 ... scale copies of a depth frame where 0 means no reading.
+// every pooling mode ignores pixels without depth, a coarse pixel is 0
+// only when all of its 2x2 children are.
+//
+//   MIN     nearest depth, conservative for collision and blob search
+//   MAX     farthest depth
+//   MEDIAN  median of the valid children (mean of the middle two of 4)
+//   MEAN    mean of the valid children
+//
+// levels are computed on first access after update(), in one streaming
+// pass: each source row pair feeds level 1, which feeds level 2 as soon as
+// two of its rows are done, and so on. all levels share one allocation.
+
+class ofxNI2::DepthPyramid
+{
+public:
+
+	enum Pooling
+	{
+		MIN,
+		MAX,
+		MEDIAN,
+		MEAN
+	};
+
+	DepthPyramid() : pooling(MIN), num_levels(3), source(NULL), computed(0) {}
+
+	// nothing is computed here, src must stay untouched until the levels
+	// of this frame have been read
+	void update(const ofShortPixels& src)
+	{
+		assert(src.getNumChannels() == 1);
+
+		source = &src;
+		computed = 0;
+
+		allocate(src.getWidth(), src.getHeight());
+	}
+
+	// 0 is the source frame itself
+	const ofShortPixels& getLevel(int i)
+	{
+		assert(source && i >= 0 && i <= num_levels);
+
+		if (i == 0) return *source;
+
+		compute(i);
+		return views[i];
+	}
+
+	// number of levels below the source
+	void setNumLevels(int n)
+	{
+		num_levels = ofClamp(n, 1, 8);
+		computed = 0;
+
+		// getLevel() may come before the next update()
+		if (source) allocate(levels[0].width, levels[0].height);
+	}
+
+	int getNumLevels() const { return num_levels; }
+
+	void setPooling(Pooling p) { pooling = p; computed = 0; }
+	Pooling getPooling() const { return pooling; }
+
+protected:
+
+	typedef simd::Vec<unsigned short> V;
+
+	struct Level
+	{
+		int width, height;
+		int offset;
+	};
+
+	Pooling pooling;
+	int num_levels;
+
+	const ofShortPixels *source;
+	int computed;
+
+	// index 0 describes the source
+	vector<Level> levels;
+	vector<unsigned short> storage;
+	vector<ofShortPixels> views;
+
+	void allocate(int w, int h)
+	{
+		if (levels.size() == num_levels + 1
+			&& levels[0].width == w
+			&& levels[0].height == h) return;
+
+		levels.resize(num_levels + 1);
+		views.resize(num_levels + 1);
+
+		levels[0].width = w;
+		levels[0].height = h;
+		levels[0].offset = 0;
+
+		int offset = 0;
+
+		for (int i = 1; i <= num_levels; i++)
+		{
+			w = (w + 1) / 2;
+			h = (h + 1) / 2;
+
+			levels[i].width = w;
+			levels[i].height = h;
+			levels[i].offset = offset;
+
+			offset += w * h;
+		}
+
+		storage.resize(offset);
+
+		for (int i = 1; i <= num_levels; i++)
+			views[i].setFromExternalPixels(&storage[levels[i].offset], levels[i].width, levels[i].height, 1);
+	}
+
+	inline const unsigned short* getRow(int l, int y) const
+	{
+		if (l == 0) return source->getPixels() + y * levels[0].width;
+		return &storage[levels[l].offset + y * levels[l].width];
+	}
+
+	// builds levels computed + 1 .. target, reading level computed once
+	void compute(int target)
+	{
+		if (target <= computed) return;
+
+		const int first = computed + 1;
+
+		for (int y = 0; y < levels[first].height; y++)
+		{
+			reduceRow(first, y);
+			cascade(first, y, target);
+		}
+
+		computed = target;
+	}
+
+	// row r of level l is done, build the parent row once both children are
+	void cascade(int l, int r, int target)
+	{
+		if (l >= target) return;
+
+		if ((r & 1) || r == levels[l].height - 1)
+		{
+			reduceRow(l + 1, r / 2);
+			cascade(l + 1, r / 2, target);
+		}
+	}
+
+	void reduceRow(int l, int y)
+	{
+		switch (pooling)
+		{
+			case MIN: reduceRow<MIN>(l, y); break;
+			case MAX: reduceRow<MAX>(l, y); break;
+			case MEDIAN: reduceRow<MEDIAN>(l, y); break;
+			case MEAN: reduceRow<MEAN>(l, y); break;
+		}
+	}
+
+	template <int MODE>
+	void reduceRow(int l, int y)
+	{
+		const Level &in = levels[l - 1];
+		const Level &out = levels[l];
+
+		const unsigned short *r0 = getRow(l - 1, y * 2);
+		const unsigned short *r1 = getRow(l - 1, std::min(y * 2 + 1, in.height - 1));
+
+		unsigned short *dst = &storage[out.offset + y * out.width];
+
+		int x = 0;
+
+		// MEAN needs more than 16 bits for the sum, it stays scalar
+		if (MODE != MEAN)
+		{
+			for (; (x + V::WIDTH) * 2 <= in.width; x += V::WIDTH)
+			{
+				V a, b, c, d;
+				simd::unzip(V::load(r0 + x * 2), V::load(r0 + x * 2 + V::WIDTH), a, b);
+				simd::unzip(V::load(r1 + x * 2), V::load(r1 + x * 2 + V::WIDTH), c, d);
+
+				pool<MODE>(a, b, c, d).store(dst + x);
+			}
+		}
+
+		for (; x < out.width; x++)
+		{
+			const int xa = x * 2;
+			const int xb = std::min(xa + 1, in.width - 1);
+
+			dst[x] = pool<MODE>(r0[xa], r0[xb], r1[xa], r1[xb]);
+		}
+	}
+
+	template <int MODE>
+	static inline V pool(V a, V b, V c, V d)
+	{
+		if (MODE == MIN)
+		{
+			// min of the valid values: 0 wraps around to the largest value
+			const V minus_one = V::set1(0xFFFF);
+			const V m = simd::min(simd::min(simd::add(a, minus_one), simd::add(b, minus_one)),
+								  simd::min(simd::add(c, minus_one), simd::add(d, minus_one)));
+			return simd::add(m, V::set1(1));
+		}
+		else if (MODE == MAX)
+		{
+			return simd::max(simd::max(a, b), simd::max(c, d));
+		}
+		else
+		{
+			// sorted, missing values come first. with k of them the median
+			// is avg(s[1], s[2]), s[2], avg(s[2], s[3]), s[3], 0
+			simd::sort2(a, b);
+			simd::sort2(c, d);
+			simd::sort2(a, c);
+			simd::sort2(b, d);
+			simd::sort2(b, c);
+
+			const V zero = V::set1(0);
+
+			const V lo = select(simd::eq(a, zero), select(simd::eq(c, zero), d, c), b);
+			const V hi = select(simd::eq(b, zero), d, c);
+
+			return simd::avg(lo, hi);
+		}
+	}
+
+	// mask ? x : y
+	static inline V select(const V& mask, const V& x, const V& y)
+	{
+		return simd::bitOr(simd::bitAnd(mask, x), simd::bitAnd(simd::eq(mask, V::set1(0)), y));
+	}
+
+	template <int MODE>
+	static inline unsigned short pool(unsigned short a, unsigned short b, unsigned short c, unsigned short d)
+	{
+		if (MODE == MIN)
+		{
+			const unsigned short m = std::min(std::min((unsigned short)(a - 1), (unsigned short)(b - 1)),
+											  std::min((unsigned short)(c - 1), (unsigned short)(d - 1)));
+			return m + 1;
+		}
+		else if (MODE == MAX)
+		{
+			return std::max(std::max(a, b), std::max(c, d));
+		}
+		else if (MODE == MEDIAN)
+		{
+			unsigned short s[4] = { a, b, c, d };
+			std::sort(s, s + 4);
+
+			const unsigned int lo = s[0] ? s[1] : (s[2] ? s[2] : s[3]);
+			const unsigned int hi = s[1] ? s[2] : s[3];
+
+			return (lo + hi + 1) >> 1;
+		}
+		else
+		{
+			const unsigned int n = (a != 0) + (b != 0) + (c != 0) + (d != 0);
+			if (n == 0) return 0;
+
+			return ((unsigned int)a + b + c + d + n / 2) / n;
+		}
+	}
+};
@@ -13,7 +13,7 @@ public:
 	
 	void setup(DepthStream& depth_stream)
 	{
-		cam.setFov(depth_stream.getVerticalFieldOfView());
+		cam.setFov(depth_stream.getIntrinsics().getVerticalFieldOfView());
 		
 		ofFbo::Settings s;
 		s.width = depth_stream.getWidth();
@@ -0,0 +1,287 @@
+#pragma once
+
+#include "ofMain.h"
+#include "utils/Simd.h"
+#include "utils/WorkerPool.h"
+
+namespace ofxNI2
+{
+	class FlyingPixelFilter;
+}
+
+// removes the pixels hanging between foreground and background at depth
+// discontinuities. a pixel is dropped (set to 0) when the depth step to
+// any of its 4 neighbours with depth is larger than
+//
+//   max(min_depth_change, max_depth_change_factor * min(z, neighbour))
+//
+// i.e. a neighbour depth ratio test with an absolute floor for the near
+// range. the test is a single pass of 8 lane vectors. the dropped mask can
+// be dilated by a few pixels, which also takes out the fringe around it.
+
+class ofxNI2::FlyingPixelFilter
+{
+public:
+
+	FlyingPixelFilter() : min_depth_change(20), max_depth_change_factor(0.03), dilation(0), pool(NULL), width(0), height(0), depth_pix(NULL) {}
+
+	const ofShortPixels& update(const ofShortPixels& depth)
+	{
+		assert(depth.getNumChannels() == 1);
+
+		width = depth.getWidth();
+		height = depth.getHeight();
+		depth_pix = depth.getPixels();
+
+		if (!result.isAllocated()
+			|| result.getWidth() != width
+			|| result.getHeight() != height)
+		{
+			result.allocate(width, height, 1);
+		}
+
+		zero_row.assign(width, 0);
+
+		WorkerPool &p = pool ? *pool : WorkerPool::getShared();
+
+		Task task;
+		task.self = this;
+
+		if (dilation == 0)
+		{
+			task.phase = FILTER;
+			p.run(task, 0, height, ROWS_PER_TASK);
+		}
+		else
+		{
+			keep.resize(width * height);
+			eroded.resize(width * height);
+
+			task.phase = FILTER;
+			p.run(task, 0, height, ROWS_PER_TASK);
+
+			task.phase = DILATE_H;
+			p.run(task, 0, height, ROWS_PER_TASK);
+
+			task.phase = DILATE_V;
+			p.run(task, 0, height, ROWS_PER_TASK);
+		}
+
+		return result;
+	}
+
+	const ofShortPixels& getPixels() const { return result; }
+
+	// in raw depth units
+	void setMinDepthChange(int v) { min_depth_change = ofClamp(v, 0, 65535); }
+	int getMinDepthChange() const { return min_depth_change; }
+
+	// allowed step as a fraction of the nearer depth
+	void setMaxDepthChangeFactor(float v) { max_depth_change_factor = ofClamp(v, 0, 0.999); }
+	float getMaxDepthChangeFactor() const { return max_depth_change_factor; }
+
+	// radius in pixels the dropped mask grows by, 0 disables
+	void setDilation(int v) { dilation = ofClamp(v, 0, 8); }
+	int getDilation() const { return dilation; }
+
+	// NULL uses WorkerPool::getShared()
+	void setWorkerPool(WorkerPool *p) { pool = p; }
+
+protected:
+
+	typedef simd::Vec<unsigned short> V;
+
+	enum Phase
+	{
+		FILTER,
+		DILATE_H,
+		DILATE_V
+	};
+
+	class Task : public ParallelTask
+	{
+	public:
+
+		FlyingPixelFilter *self;
+		Phase phase;
+
+		void run(int begin, int end)
+		{
+			switch (phase)
+			{
+				case FILTER: self->filter(begin, end); break;
+				case DILATE_H: self->dilateH(begin, end); break;
+				case DILATE_V: self->dilateV(begin, end); break;
+			}
+		}
+	};
+
+	enum { ROWS_PER_TASK = 16 };
+
+	int min_depth_change;
+	float max_depth_change_factor;
+	int dilation;
+
+	WorkerPool *pool;
+
+	int width, height;
+	const unsigned short *depth_pix;
+
+	// stands in for the rows above and below the frame
+	vector<unsigned short> zero_row;
+
+	// 0xFFFF where the pixel is kept
+	vector<unsigned short> keep, eroded;
+
+	ofShortPixels result;
+
+	inline unsigned short getFactor() const
+	{
+		return max_depth_change_factor * 65536;
+	}
+
+	// 0xFFFF if z survives neighbour n, same math as the vector version.
+	// pixels without depth are kept, so only flying pixels are dilated and
+	// not every hole and shadow
+	inline static unsigned short test(unsigned short z, unsigned short n, unsigned short min_change, unsigned short factor)
+	{
+		if (z == 0 || n == 0) return 0xFFFF;
+
+		const int diff = abs(z - n);
+		const int thr = std::max<int>(min_change, ((unsigned int)std::min(z, n) * factor) >> 16);
+
+		return diff > thr ? 0 : 0xFFFF;
+	}
+
+	inline static V test(const V& z, const V& n, const V& min_change, const V& factor, const V& zero)
+	{
+		const V diff = simd::bitOr(simd::subs(z, n), simd::subs(n, z));
+		const V thr = simd::max(min_change, simd::mulhi(simd::min(z, n), factor));
+
+		// diff <= thr, or no depth on either side
+		const V none = simd::bitOr(simd::eq(z, zero), simd::eq(n, zero));
+		return simd::bitOr(simd::eq(simd::subs(diff, thr), zero), none);
+	}
+
+	inline unsigned short testScalar(const unsigned short *up, const unsigned short *row, const unsigned short *down, int x, unsigned short min_change, unsigned short factor) const
+	{
+		const unsigned short z = row[x];
+
+		const unsigned short l = x > 0 ? row[x - 1] : 0;
+		const unsigned short r = x + 1 < width ? row[x + 1] : 0;
+
+		return test(z, l, min_change, factor)
+			& test(z, r, min_change, factor)
+			& test(z, up[x], min_change, factor)
+			& test(z, down[x], min_change, factor);
+	}
+
+	void filter(int y0, int y1)
+	{
+		const unsigned short min_change = min_depth_change;
+		const unsigned short factor = getFactor();
+
+		const V vmin_change = V::set1(min_change);
+		const V vfactor = V::set1(factor);
+		const V zero = V::set1(0);
+
+		const bool write_mask = dilation > 0;
+
+		for (int y = y0; y < y1; y++)
+		{
+			const unsigned short *row = depth_pix + y * width;
+			const unsigned short *up = y > 0 ? row - width : &zero_row[0];
+			const unsigned short *down = y + 1 < height ? row + width : &zero_row[0];
+
+			unsigned short *dst = write_mask ? &keep[y * width] : result.getPixels() + y * width;
+
+			int x = 0;
+
+			if (x < width)
+			{
+				const unsigned short k = testScalar(up, row, down, x, min_change, factor);
+				dst[x] = write_mask ? k : row[x] & k;
+				x++;
+			}
+
+			// left and right loads stay inside the row
+			for (; x + V::WIDTH < width; x += V::WIDTH)
+			{
+				const V z = V::load(row + x);
+
+				V k = test(z, V::load(row + x - 1), vmin_change, vfactor, zero);
+				k = simd::bitAnd(k, test(z, V::load(row + x + 1), vmin_change, vfactor, zero));
+				k = simd::bitAnd(k, test(z, V::load(up + x), vmin_change, vfactor, zero));
+				k = simd::bitAnd(k, test(z, V::load(down + x), vmin_change, vfactor, zero));
+
+				if (write_mask) k.store(dst + x);
+				else simd::bitAnd(z, k).store(dst + x);
+			}
+
+			for (; x < width; x++)
+			{
+				const unsigned short k = testScalar(up, row, down, x, min_change, factor);
+				dst[x] = write_mask ? k : row[x] & k;
+			}
+		}
+	}
+
+	// growing the dropped mask is eroding the keep mask, one separable
+	// min filter
+	void dilateH(int y0, int y1)
+	{
+		const int r = dilation;
+
+		for (int y = y0; y < y1; y++)
+		{
+			const unsigned short *src = &keep[y * width];
+			unsigned short *dst = &eroded[y * width];
+
+			for (int x = 0; x < width; x++)
+			{
+				const int x0 = std::max(x - r, 0);
+				const int x1 = std::min(x + r, width - 1);
+
+				unsigned short m = 0xFFFF;
+				for (int i = x0; i <= x1; i++)
+					m = std::min(m, src[i]);
+
+				dst[x] = m;
+			}
+		}
+	}
+
+	void dilateV(int y0, int y1)
+	{
+		const int r = dilation;
+
+		for (int y = y0; y < y1; y++)
+		{
+			const int ya = std::max(y - r, 0);
+			const int yb = std::min(y + r, height - 1);
+
+			const unsigned short *src = depth_pix + y * width;
+			unsigned short *dst = result.getPixels() + y * width;
+
+			int x = 0;
+
+			for (; x + V::WIDTH <= width; x += V::WIDTH)
+			{
+				V m = V::load(&eroded[ya * width + x]);
+				for (int i = ya + 1; i <= yb; i++)
+					m = simd::min(m, V::load(&eroded[i * width + x]));
+
+				simd::bitAnd(V::load(src + x), m).store(dst + x);
+			}
+
+			for (; x < width; x++)
+			{
+				unsigned short m = 0xFFFF;
+				for (int i = ya; i <= yb; i++)
+					m = std::min(m, eroded[i * width + x]);
+
+				dst[x] = src[x] & m;
+			}
+		}
+	}
+};
@@ -0,0 +1,596 @@
+#pragma once
+
+#include "ofxNI2.h"
+#include "utils/RecordingWriter.h"
+
+#include "Poco/Event.h"
+
+namespace ofxNI2
+{
+	class FrameRecorder;
+}
+
+// records Depth/Ir/ColorStream frames without going through
+// openni::Recorder. the capture thread only copies each frame into a
+// bounded queue, encoding and disk writes happen on a writer thread.
+// 16bit depth and IR are stored with RvlCodec, everything else raw.
+//
+// what happens when the writer can't keep up and the queue is full is up
+// to setDropPolicy(), by default new frames are dropped. only BLOCK lets
+// the disk slow down capture. the getters below tell how close to that
+// the writer is.
+//
+// with setSegmentLimits() the recording is split into files of limited
+// length or size. the writer thread rolls over between two frames, and
+// keeps a manifest at the path given to start(), which RecordingReader
+// opens as one recording. a crash only loses the index of the last
+// segment, which RecordingReader can recover.
+//
+// see RecordingFormat.h for the file layout, RecordingReader reads it back.
+
+class ofxNI2::FrameRecorder : public ofxNI2::FrameListener
+{
+public:
+
+	enum DropPolicy
+	{
+		// the capture thread waits for a free slot
+		BLOCK,
+
+		// queued frames make room for new ones
+		DROP_OLDEST,
+
+		// new frames are dropped
+		DROP_NEWEST,
+
+		// like DROP_NEWEST, and while the queue is over half full depth
+		// and IR lose up to MAX_DOWNGRADE low bits, which RVL stores in
+		// far fewer bytes. RecordingReader shifts them back
+		DOWNGRADE
+	};
+
+	enum
+	{
+		MAX_DOWNGRADE = 4
+	};
+
+	FrameRecorder() : segment_seconds(0), segment_megabytes(0), drop_policy(DROP_NEWEST), recording(false), head(0), tail(0), count(0), max_count(0), num_dropped(0), num_written(0), bytes_written(0), raw_bytes_written(0), blocked_time(0), encode_time(0), write_time(0), bytes_per_second(0), downgrade(0), writer(this) {}
+	~FrameRecorder() { stop(); }
+
+	// streams can't be added while recording. returns the stream index
+	int addStream(Stream &stream)
+	{
+		const openni::VideoStream &s = stream.get();
+		const openni::VideoMode mode = s.getVideoMode();
+
+		const int index = addStream(s.getSensorInfo().getSensorType(), mode.getPixelFormat(), mode.getResolutionX(), mode.getResolutionY(), mode.getFps(), stream.getIntrinsics());
+
+		sources.resize(index + 1, NULL);
+		sources[index] = &stream;
+
+		return index;
+	}
+
+	// for frames passed in with addFrame()
+	int addStream(openni::SensorType type, openni::PixelFormat format, int width, int height, int fps = 30, const Intrinsics& intrinsics = Intrinsics())
+	{
+		assert(!isRecording());
+
+		stream_headers.push_back(recording::makeStreamHeader(type, format, width, height, fps, intrinsics));
+		frame_counters.push_back(0);
+
+		return stream_headers.size() - 1;
+	}
+
+	int getNumStreams() const { return stream_headers.size(); }
+
+	// a new segment starts when the current one is this long or large,
+	// 0 for no limit. has to be set before start()
+	void setSegmentLimits(float seconds, int megabytes = 0)
+	{
+		assert(!isRecording());
+
+		segment_seconds = std::max(seconds, 0.f);
+		segment_megabytes = std::max(megabytes, 0);
+	}
+
+	bool isSegmented() const { return segment_seconds > 0 || segment_megabytes > 0; }
+
+	void setDropPolicy(DropPolicy v) { ofScopedLock lock(queue_mutex); drop_policy = v; }
+	DropPolicy getDropPolicy() const { return drop_policy; }
+
+	// segments written so far, including the current one
+	int getNumSegments() { ofScopedLock lock(queue_mutex); return segments.size(); }
+
+	bool start(const string& path, int queue_capacity = 32)
+	{
+		stop();
+
+		this->path = path;
+		segments.clear();
+
+		if (isSegmented())
+		{
+			if (!openSegment()) return false;
+		}
+		else
+		{
+			if (!output.open(path, stream_headers)) return false;
+		}
+
+		slots.resize(std::max(queue_capacity, 1));
+		head = tail = count = max_count = 0;
+		num_dropped = num_written = 0;
+		bytes_written = output.getSize();
+		raw_bytes_written = 0;
+
+		blocked_time = 0;
+		encode_time = write_time = 0;
+		bytes_per_second = 0;
+		downgrade = 0;
+
+		for (int i = 0; i < frame_counters.size(); i++)
+			frame_counters[i] = 0;
+
+		recording = true;
+		writer.startThread(true, false);
+
+		for (int i = 0; i < sources.size(); i++)
+			if (sources[i]) sources[i]->addFrameListener(this);
+
+		return true;
+	}
+
+	// writes out what is still queued and the index, then closes the file
+	void stop()
+	{
+		if (!isRecording()) return;
+
+		for (int i = 0; i < sources.size(); i++)
+			if (sources[i]) sources[i]->removeFrameListener(this);
+
+		queue_mutex.lock();
+		recording = false;
+		queue_mutex.unlock();
+
+		// wakes up blocked producers
+		slot_freed.set();
+
+		writer.stopThread();
+		frame_queued.set();
+		writer.waitForThread(false);
+
+		const uint64_t size = closeSegment();
+
+		ofScopedLock lock(queue_mutex);
+		bytes_written += size;
+	}
+
+	bool isRecording() const { return recording; }
+
+	// thread safe. data is copied, stride 0 means tightly packed rows.
+	// false if the frame was dropped
+	bool addFrame(int stream, const void *data, int width, int height, uint64_t timestamp, int frame_index = -1, int stride = 0)
+	{
+		assert(stream >= 0 && stream < stream_headers.size());
+
+		const int bpp = recording::getBytesPerPixel((openni::PixelFormat)stream_headers[stream].pixel_format);
+		const int row_size = width * bpp;
+		if (stride == 0) stride = row_size;
+
+		queue_mutex.lock();
+
+		if (!recording)
+		{
+			queue_mutex.unlock();
+			return false;
+		}
+
+		if (frame_index < 0) frame_index = frame_counters[stream];
+		frame_counters[stream]++;
+
+		if (count == slots.size())
+		{
+			if (drop_policy == BLOCK)
+			{
+				const unsigned long long t = ofGetElapsedTimeMicros();
+
+				while (count == slots.size() && recording)
+				{
+					queue_mutex.unlock();
+					slot_freed.tryWait(10);
+					queue_mutex.lock();
+				}
+
+				blocked_time += (ofGetElapsedTimeMicros() - t) / 1000000.;
+			}
+			// a head still being copied into by another thread stays
+			else if (drop_policy == DROP_OLDEST && slots[head].ready)
+			{
+				head = (head + 1) % slots.size();
+				count--;
+				num_dropped++;
+			}
+			else
+			{
+				num_dropped++;
+			}
+
+			if (count == slots.size() || !recording)
+			{
+				queue_mutex.unlock();
+				return false;
+			}
+		}
+
+		// the slot is taken now and filled without the lock, so the writer
+		// isn't held up by the copy
+		Slot &s = slots[tail];
+		s.stream = stream;
+		s.timestamp = timestamp;
+		s.frame_index = frame_index;
+		s.width = width;
+		s.height = height;
+		s.ready = false;
+
+		tail = (tail + 1) % slots.size();
+		count++;
+		max_count = std::max(max_count, count);
+
+		queue_mutex.unlock();
+
+		s.data.resize(row_size * height);
+
+		const unsigned char *src = (const unsigned char*)data;
+
+		if (stride == row_size)
+		{
+			memcpy(&s.data[0], src, row_size * height);
+		}
+		else
+		{
+			for (int y = 0; y < height; y++)
+				memcpy(&s.data[y * row_size], src + y * stride, row_size);
+		}
+
+		queue_mutex.lock();
+		s.ready = true;
+		queue_mutex.unlock();
+
+		frame_queued.set();
+
+		return true;
+	}
+
+	unsigned int getNumDropped() { ofScopedLock lock(queue_mutex); return num_dropped; }
+	unsigned int getNumWritten() { ofScopedLock lock(queue_mutex); return num_written; }
+
+	// frames waiting for the writer
+	int getQueueSize() { ofScopedLock lock(queue_mutex); return count; }
+	int getQueueCapacity() const { return slots.size(); }
+
+	// the fullest the queue has been
+	int getMaxQueueSize() { ofScopedLock lock(queue_mutex); return max_count; }
+
+	// file throughput over the last second
+	float getBytesPerSecond() { ofScopedLock lock(queue_mutex); return bytes_per_second; }
+
+	// averages per frame in milliseconds
+	float getEncodeTime() { ofScopedLock lock(queue_mutex); return encode_time; }
+	float getWriteTime() { ofScopedLock lock(queue_mutex); return write_time; }
+
+	// seconds capture threads waited with BLOCK
+	float getBlockedTime() { ofScopedLock lock(queue_mutex); return blocked_time; }
+
+	// bits currently dropped from depth with DOWNGRADE
+	int getDowngradeLevel() { ofScopedLock lock(queue_mutex); return downgrade; }
+
+	uint64_t getBytesWritten() { ofScopedLock lock(queue_mutex); return bytes_written; }
+
+	// file size relative to the uncompressed frames
+	float getCompressionRatio()
+	{
+		ofScopedLock lock(queue_mutex);
+		return raw_bytes_written ? (double)bytes_written / raw_bytes_written : 1;
+	}
+
+protected:
+
+	struct Slot
+	{
+		vector<unsigned char> data;
+		int stream;
+		uint64_t timestamp;
+		int frame_index;
+		int width, height;
+
+		// false while addFrame() copies into it, not swapped
+		bool ready;
+
+		Slot() : stream(0), timestamp(0), frame_index(0), width(0), height(0), ready(false) {}
+
+		// keeps both buffers allocated
+		void swap(Slot &o)
+		{
+			data.swap(o.data);
+			std::swap(stream, o.stream);
+			std::swap(timestamp, o.timestamp);
+			std::swap(frame_index, o.frame_index);
+			std::swap(width, o.width);
+			std::swap(height, o.height);
+		}
+	};
+
+	class Writer : public ofThread
+	{
+	public:
+
+		Writer(FrameRecorder *recorder) : recorder(recorder) {}
+
+	protected:
+
+		FrameRecorder *recorder;
+
+		void threadedFunction()
+		{
+			Slot slot;
+			int downgrade = 0;
+
+			unsigned long long window_start = ofGetElapsedTimeMicros();
+			uint64_t window_bytes = 0;
+
+			while (true)
+			{
+				recorder->queue_mutex.lock();
+
+				const int count = recorder->count;
+
+				// frames are written in order, the next one may still be copied
+				if (count == 0 || !recorder->slots[recorder->head].ready)
+				{
+					recorder->queue_mutex.unlock();
+
+					// the queue is drained before leaving
+					if (count == 0 && !isThreadRunning()) break;
+
+					recorder->frame_queued.wait();
+					continue;
+				}
+
+				// the frame leaves the queue, so DROP_OLDEST can't touch it
+				slot.swap(recorder->slots[recorder->head]);
+				recorder->head = (recorder->head + 1) % recorder->slots.size();
+				recorder->count--;
+
+				if (recorder->drop_policy != DOWNGRADE)
+					downgrade = 0;
+				else if (recorder->count * 2 > recorder->slots.size())
+					downgrade = std::min(downgrade + 1, (int)MAX_DOWNGRADE);
+				else if (recorder->count == 0)
+					downgrade = std::max(downgrade - 1, 0);
+
+				recorder->queue_mutex.unlock();
+
+				recorder->slot_freed.set();
+
+				float encode_ms, write_ms;
+				const size_t size = recorder->write(slot, downgrade, encode_ms, write_ms);
+
+				window_bytes += size;
+				const unsigned long long now = ofGetElapsedTimeMicros();
+
+				recorder->queue_mutex.lock();
+				recorder->num_written++;
+				recorder->bytes_written += size;
+				recorder->raw_bytes_written += slot.data.size();
+				recorder->encode_time += (encode_ms - recorder->encode_time) * 0.1;
+				recorder->write_time += (write_ms - recorder->write_time) * 0.1;
+				recorder->downgrade = downgrade;
+
+				if (now - window_start >= 1000000)
+				{
+					recorder->bytes_per_second = window_bytes * 1000000. / (now - window_start);
+					window_start = now;
+					window_bytes = 0;
+				}
+
+				recorder->queue_mutex.unlock();
+			}
+		}
+	};
+
+	RecordingWriter output;
+	string path;
+
+	float segment_seconds;
+	int segment_megabytes;
+
+	DropPolicy drop_policy;
+
+	struct Segment
+	{
+		string file;
+		int num_frames;
+		uint64_t first_timestamp, last_timestamp;
+	};
+
+	// guarded by queue_mutex, the writer thread appends
+	vector<Segment> segments;
+
+	bool recording;
+
+	vector<recording::StreamHeader> stream_headers;
+	vector<int> frame_counters;
+	vector<Stream*> sources;
+
+	// ring of slots. count includes slots addFrame() is still copying
+	// into, the writer swaps a frame out of slots[head] once it is ready
+	vector<Slot> slots;
+	int head, tail, count, max_count;
+	ofMutex queue_mutex;
+	Poco::Event frame_queued, slot_freed;
+
+	unsigned int num_dropped, num_written;
+	uint64_t bytes_written, raw_bytes_written;
+
+	float blocked_time;
+	float encode_time, write_time;
+	float bytes_per_second;
+	int downgrade;
+
+	// writer thread only
+	vector<unsigned char> encoded;
+
+	Writer writer;
+
+	// returns bytes written to the file
+	size_t write(Slot &s, int downgrade, float &encode_ms, float &write_ms)
+	{
+		recording::FrameHeader h;
+		h.stream = s.stream;
+		h.frame_index = s.frame_index;
+		h.timestamp = s.timestamp;
+		h.width = s.width;
+		h.height = s.height;
+		h.raw_size = s.data.size();
+
+		size_t size = 0;
+
+		if (isSegmented() && output.getNumFrames() > 0)
+		{
+			const Segment &current = segments.back();
+
+			if ((segment_seconds > 0 && s.timestamp >= current.first_timestamp + (uint64_t)(segment_seconds * 1000000))
+				|| (segment_megabytes > 0 && output.getSize() >= ((uint64_t)segment_megabytes << 20)))
+			{
+				size += closeSegment();
+
+				// a failed open loses the rest of the recording, as a full disk would
+				if (!openSegment()) return size;
+
+				size += output.getSize();
+			}
+		}
+
+		const recording::StreamHeader &sh = stream_headers[s.stream];
+
+		unsigned long long t = ofGetElapsedTimeMicros();
+
+		h.depth_shift = 0;
+
+		if (downgrade > 0 && recording::isRvlFormat((openni::PixelFormat)sh.pixel_format) && !s.data.empty())
+		{
+			unsigned short *p = (unsigned short*)&s.data[0];
+			const int n = s.data.size() / 2;
+
+			for (int i = 0; i < n; i++)
+				p[i] >>= downgrade;
+
+			h.depth_shift = downgrade;
+		}
+
+		const unsigned char *payload = RecordingWriter::encode(sh, h, s.data.empty() ? NULL : &s.data[0], encoded);
+
+		encode_ms = (ofGetElapsedTimeMicros() - t) / 1000.;
+		t = ofGetElapsedTimeMicros();
+
+		if (output.isOpen())
+			size += output.write(h, payload);
+
+		write_ms = (ofGetElapsedTimeMicros() - t) / 1000.;
+
+		if (!output.isOpen()) return size;
+
+		if (isSegmented())
+		{
+			ofScopedLock lock(queue_mutex);
+
+			Segment &current = segments.back();
+			if (current.num_frames++ == 0) current.first_timestamp = s.timestamp;
+			current.last_timestamp = std::max(current.last_timestamp, s.timestamp);
+		}
+
+		return size;
+	}
+
+	bool openSegment()
+	{
+		const size_t dot = path.find_last_of('.');
+		const size_t slash = path.find_last_of("/\\");
+		const bool has_ext = dot != string::npos && (slash == string::npos || dot > slash);
+
+		const string base = has_ext ? path.substr(0, dot) : path;
+		const string ext = has_ext ? path.substr(dot) : "";
+		const string file = base + "_" + ofToString(segments.size(), 4, '0') + ext;
+
+		if (!output.open(file, stream_headers)) return false;
+
+		Segment seg;
+		seg.file = slash == string::npos ? file : file.substr(slash + 1);
+		seg.num_frames = 0;
+		seg.first_timestamp = seg.last_timestamp = 0;
+
+		queue_mutex.lock();
+		segments.push_back(seg);
+		queue_mutex.unlock();
+
+		writeManifest();
+
+		return true;
+	}
+
+	// returns the bytes added by the index
+	uint64_t closeSegment()
+	{
+		if (!output.isOpen()) return 0;
+
+		const uint64_t size = output.getSize();
+		output.close();
+
+		if (isSegmented()) writeManifest();
+
+		return output.getSize() - size;
+	}
+
+	// written next to the manifest and renamed, so there always is a complete one
+	void writeManifest()
+	{
+		const string manifest_path = ofToDataPath(path);
+		const string temp_path = manifest_path + ".tmp";
+
+		FILE *fp = fopen(temp_path.c_str(), "w");
+		if (!fp)
+		{
+			ofLogError("ofxNI2::FrameRecorder") << "can't write " << temp_path;
+			return;
+		}
+
+		fprintf(fp, "%s\n", recording::MANIFEST_HEADER);
+
+		queue_mutex.lock();
+		for (int i = 0; i < segments.size(); i++)
+		{
+			const Segment &seg = segments[i];
+			fprintf(fp, "%s %d %llu %llu\n", seg.file.c_str(), seg.num_frames, (unsigned long long)seg.first_timestamp, (unsigned long long)seg.last_timestamp);
+		}
+		queue_mutex.unlock();
+
+		fclose(fp);
+
+#ifdef TARGET_WIN32
+		remove(manifest_path.c_str());
+#endif
+		rename(temp_path.c_str(), manifest_path.c_str());
+	}
+
+	void onNewFrame(Stream &stream, const Frame &frame)
+	{
+		for (int i = 0; i < sources.size(); i++)
+		{
+			if (sources[i] != &stream) continue;
+
+			addFrame(i, frame.data, frame.width, frame.height, frame.timestamp, frame.frame_index, frame.stride);
+			return;
+		}
+	}
+};
@@ -0,0 +1,140 @@
+#pragma once
+
+#include "ofMain.h"
+
+#include "OpenNI.h"
+#include "PS1080.h"
+
+namespace ofxNI2
+{
+	struct Intrinsics;
+}
+
+// pinhole model of a stream, derived once per video mode.
+// unproject() returns OpenNI world coordinates (Y up, Z forward), always in
+// millimeters. it may differ from openni::CoordinateConverter::
+// convertDepthToWorld: that keeps 100um streams in raw units, and uses the
+// field of view where PS1080 devices give the zero plane focal length here
+
+struct ofxNI2::Intrinsics
+{
+public:
+
+	float fx, fy;
+	float cx, cy;
+	float inv_fx, inv_fy;
+
+	int width, height;
+
+	// millimeters per raw depth unit
+	float depth_unit;
+
+	Intrinsics() : fx(1), fy(1), cx(0), cy(0), inv_fx(1), inv_fy(1), width(0), height(0), depth_unit(1) {}
+
+	void setup(int w, int h, float _fx, float _fy, float _cx, float _cy, float _depth_unit = 1)
+	{
+		width = w;
+		height = h;
+		fx = _fx;
+		fy = _fy;
+		cx = _cx;
+		cy = _cy;
+		inv_fx = 1. / fx;
+		inv_fy = 1. / fy;
+		depth_unit = _depth_unit;
+	}
+
+	// fov in radians
+	void setupFromFov(int w, int h, float fovH, float fovV, float _depth_unit = 1)
+	{
+		setup(w, h,
+			  w / (tan(fovH * 0.5) * 2),
+			  h / (tan(fovV * 0.5) * 2),
+			  w * 0.5, h * 0.5,
+			  _depth_unit);
+	}
+
+	bool setup(const openni::VideoStream& stream)
+	{
+		if (!stream.isValid()) return false;
+
+		const openni::VideoMode m = stream.getVideoMode();
+		const int w = m.getResolutionX();
+		const int h = m.getResolutionY();
+
+		float unit = 1;
+		if (m.getPixelFormat() == openni::PIXEL_FORMAT_DEPTH_100_UM)
+			unit = 0.1;
+
+		// PS1080 devices report the calibrated zero plane, which is
+		// more accurate than the nominal FOV
+
+		unsigned long long zpd = 0;
+		double zpps = 0;
+
+		if (stream.getProperty(XN_STREAM_PROPERTY_ZERO_PLANE_DISTANCE, &zpd) == openni::STATUS_OK
+			&& stream.getProperty(XN_STREAM_PROPERTY_ZERO_PLANE_PIXEL_SIZE, &zpps) == openni::STATUS_OK
+			&& zpd > 0 && zpps > 0)
+		{
+			// pixel size is given for the 1280px wide sensor
+			const float f = (zpd / zpps) * (w / 1280.);
+			setup(w, h, f, f, w * 0.5, h * 0.5, unit);
+		}
+		else
+		{
+			setupFromFov(w, h, stream.getHorizontalFieldOfView(), stream.getVerticalFieldOfView(), unit);
+		}
+
+		return true;
+	}
+
+	inline bool isValid() const { return width > 0 && height > 0; }
+
+	// same model for a resampled image (e.g. downsampled depth)
+	Intrinsics getScaled(int w, int h) const
+	{
+		const float sx = (float)w / width;
+		const float sy = (float)h / height;
+
+		Intrinsics o;
+		o.setup(w, h, fx * sx, fy * sy, cx * sx, cy * sy, depth_unit);
+		return o;
+	}
+
+	// in degrees
+	inline float getHorizontalFieldOfView() const { return ofRadToDeg(atan(width * 0.5 * inv_fx) * 2); }
+	inline float getVerticalFieldOfView() const { return ofRadToDeg(atan(height * 0.5 * inv_fy) * 2); }
+
+	// z is raw depth value
+	inline ofVec3f unproject(float x, float y, float z) const
+	{
+		const float Z = z * depth_unit;
+		return ofVec3f((x - cx) * inv_fx * Z, (cy - y) * inv_fy * Z, Z);
+	}
+
+	inline void unproject(float x, float y, float z, float &X, float &Y, float &Z) const
+	{
+		Z = z * depth_unit;
+		X = (x - cx) * inv_fx * Z;
+		Y = (cy - y) * inv_fy * Z;
+	}
+
+	// returns image coordinate in x, y and raw depth in z
+	inline ofVec3f project(const ofVec3f& v) const
+	{
+		if (v.z <= 0) return ofVec3f(0, 0, 0);
+
+		const float inv_z = 1. / v.z;
+		return ofVec3f(v.x * fx * inv_z + cx, cy - v.y * fy * inv_z, v.z / depth_unit);
+	}
+
+	inline bool project(const ofVec3f& v, float &x, float &y) const
+	{
+		if (v.z <= 0) return false;
+
+		const float inv_z = 1. / v.z;
+		x = v.x * fx * inv_z + cx;
+		y = cy - v.y * fy * inv_z;
+		return true;
+	}
+};
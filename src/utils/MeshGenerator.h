@@ -15,11 +15,12 @@ public:
 	
 	void setup(DepthStream& depth_stream)
 	{
-		float fovH = depth_stream.get().getHorizontalFieldOfView();
-		float fovV = depth_stream.get().getVerticalFieldOfView();
-		
-		xzFactor = tan(fovH * 0.5) * 2;
-		yzFactor = tan(fovV * 0.5) * -2;
+		setup(depth_stream.getIntrinsics());
+	}
+	
+	void setup(const Intrinsics& intrinsics)
+	{
+		this->intrinsics = intrinsics;
 	}
 	
 	const ofMesh& update(const ofShortPixels& depth, const ofPixels& color = ofPixels())
@@ -28,8 +29,10 @@ public:
 		
 		const int W = depth.getWidth();
 		const int H = depth.getHeight();
-		const float invW = 1. / W;
-		const float invH = 1. / H;
+		
+		if (intrinsics.isValid()
+			&& (intrinsics.width != W || intrinsics.height != H))
+			intrinsics = intrinsics.getScaled(W, H);
 		
 		const unsigned short *depth_pix = depth.getPixels();
 		
@@ -60,11 +63,8 @@ public:
 					{
 						const int idx = y * W + x;
 						
-						const float Z = depth_pix[idx];
-						const float normX = x * invW - 0.5;
-						const float normY = y * invH - 0.5;
-						const float X = normX * xzFactor * Z;
-						const float Y = normY * yzFactor * Z;
+						float X, Y, Z;
+						intrinsics.unproject(x, y, depth_pix[idx], X, Y, Z);
 						verts[vert_index].set(X, Y, -Z);
 						
 						const unsigned char *C = &color_pix[idx];
@@ -82,11 +82,8 @@ public:
 					{
 						const int idx = y * W + x;
 						
-						const float Z = depth_pix[idx];
-						const float normX = x * invW - 0.5;
-						const float normY = y * invH - 0.5;
-						const float X = normX * xzFactor * Z;
-						const float Y = normY * yzFactor * Z;
+						float X, Y, Z;
+						intrinsics.unproject(x, y, depth_pix[idx], X, Y, Z);
 						verts[vert_index].set(X, Y, -Z);
 						
 						const unsigned char *C = &color_pix[idx * 3];
@@ -110,9 +107,8 @@ public:
 				{
 					int idx = y * W + x;
 					
-					float Z = depth_pix[idx];
-					float X = (x * invW - 0.5) * xzFactor * Z;
-					float Y = (y * invH - 0.5) * yzFactor * Z;
+					float X, Y, Z;
+					intrinsics.unproject(x, y, depth_pix[idx], X, Y, Z);
 					verts[vert_index].set(X, Y, -Z);
 					
 					vert_index++;
@@ -138,6 +134,6 @@ protected:
 	int downsampling_level;
 	
 	ofMesh mesh;
-	float xzFactor, yzFactor;
+	Intrinsics intrinsics;
 	
 };
@@ -0,0 +1,304 @@
+#pragma once
+
+#include "ofxNI2.h"
+#include "utils/WorkerPool.h"
+
+namespace ofxNI2
+{
+	class NormalEstimator;
+};
+
+// normals for organized depth frames from integral images, like PCL's
+// IntegralImageNormalEstimation (AVERAGE_3D_GRADIENT). the integral images
+// hold raw depth, x * depth and y * depth as wrapping 32bit integers. box
+// sums taken relative to the box center are exact as long as they fit in
+// int32, which MAX_SMOOTHING_SIZE keeps true for any 16bit depth, and the
+// world space means are recovered with the intrinsics.
+//
+// output is aligned with MeshGenerator's vertex array for the same
+// downsampling level. invalid pixels get a zero normal.
+
+class ofxNI2::NormalEstimator
+{
+public:
+
+	NormalEstimator() : smoothing_size(5), max_depth_change_factor(0.02), pool(NULL), width(0), height(0), depth_pix(NULL), downsampling_level(1), dst(NULL) {}
+
+	void setup(DepthStream& depth_stream)
+	{
+		setup(depth_stream.getIntrinsics());
+	}
+
+	void setup(const Intrinsics& intrinsics)
+	{
+		this->intrinsics = intrinsics;
+	}
+
+	const vector<ofVec3f>& update(const ofShortPixels& depth, int downsampling_level = 1)
+	{
+		compute(depth, downsampling_level, normals);
+		return normals;
+	}
+
+	// writes into mesh.getNormals(), e.g. MeshGenerator::getMesh()
+	void update(const ofShortPixels& depth, ofMesh& mesh, int downsampling_level = 1)
+	{
+		compute(depth, downsampling_level, mesh.getNormals());
+	}
+
+	const vector<ofVec3f>& getNormals() const { return normals; }
+
+	// sum of |x - xc| * z over a 41x41 window of 65535 stays below 2^31
+	enum { MAX_SMOOTHING_SIZE = 20 };
+
+	// half size of the averaging window in pixels, up to MAX_SMOOTHING_SIZE
+	void setNormalSmoothingSize(int v) { smoothing_size = ofClamp(v, 1, MAX_SMOOTHING_SIZE); }
+	int getNormalSmoothingSize() const { return smoothing_size; }
+
+	// windows whose depth changes more than factor * depth * smoothing size
+	// are treated as crossing an edge
+	void setMaxDepthChangeFactor(float v) { max_depth_change_factor = v; }
+	float getMaxDepthChangeFactor() const { return max_depth_change_factor; }
+
+	// NULL uses WorkerPool::getShared()
+	void setWorkerPool(WorkerPool *p) { pool = p; }
+
+protected:
+
+	struct Sum
+	{
+		uint32_t z, xz, yz, n;
+	};
+
+	enum Phase
+	{
+		ROW_PREFIX,
+		COLUMN_PREFIX,
+		NORMALS
+	};
+
+	class Task : public ParallelTask
+	{
+	public:
+
+		NormalEstimator *self;
+		Phase phase;
+
+		void run(int begin, int end)
+		{
+			switch (phase)
+			{
+				case ROW_PREFIX: self->rowPrefix(begin, end); break;
+				case COLUMN_PREFIX: self->columnPrefix(begin, end); break;
+				case NORMALS: self->computeNormals(begin, end); break;
+			}
+		}
+	};
+
+	int smoothing_size;
+	float max_depth_change_factor;
+
+	WorkerPool *pool;
+	Intrinsics intrinsics;
+
+	enum { BAND = 16 };
+
+	vector<Sum> integral;
+	vector<Sum> scratch;
+	vector<ofVec3f> normals;
+
+	int width, height;
+	const unsigned short *depth_pix;
+	int downsampling_level;
+	vector<ofVec3f> *dst;
+
+	void compute(const ofShortPixels& depth, int DS, vector<ofVec3f>& out)
+	{
+		assert(depth.getNumChannels() == 1);
+
+		width = depth.getWidth();
+		height = depth.getHeight();
+		depth_pix = depth.getPixels();
+		downsampling_level = std::max(1, DS);
+		dst = &out;
+
+		if (intrinsics.isValid()
+			&& (intrinsics.width != width || intrinsics.height != height))
+			intrinsics = intrinsics.getScaled(width, height);
+
+		integral.resize((width + 1) * (height + 1));
+		scratch.resize((height / BAND + 1) * (width + 1) * 3);
+		out.resize((width / downsampling_level) * (height / downsampling_level));
+
+		// top row of the integral image stays zero
+		memset(&integral[0], 0, sizeof(Sum) * (width + 1));
+
+		WorkerPool &p = pool ? *pool : WorkerPool::getShared();
+
+		Task task;
+		task.self = this;
+
+		task.phase = ROW_PREFIX;
+		p.run(task, 0, height, BAND);
+
+		task.phase = COLUMN_PREFIX;
+		p.run(task, 1, width + 1, 64);
+
+		task.phase = NORMALS;
+		p.run(task, 0, height / downsampling_level, BAND);
+	}
+
+	void rowPrefix(int y0, int y1)
+	{
+		const int stride = width + 1;
+
+		for (int y = y0; y < y1; y++)
+		{
+			const unsigned short *src = depth_pix + y * width;
+			Sum *row = &integral[(y + 1) * stride];
+
+			Sum acc = {0, 0, 0, 0};
+			row[0] = acc;
+
+			for (int x = 0; x < width; x++)
+			{
+				const uint32_t z = src[x];
+				acc.z += z;
+				acc.xz += x * z;
+				acc.yz += y * z;
+				acc.n += z != 0;
+				row[x + 1] = acc;
+			}
+		}
+	}
+
+	void columnPrefix(int x0, int x1)
+	{
+		const int stride = width + 1;
+
+		for (int y = 2; y <= height; y++)
+		{
+			const Sum *prev = &integral[(y - 1) * stride];
+			Sum *row = &integral[y * stride];
+
+			for (int x = x0; x < x1; x++)
+			{
+				row[x].z += prev[x].z;
+				row[x].xz += prev[x].xz;
+				row[x].yz += prev[x].yz;
+				row[x].n += prev[x].n;
+			}
+		}
+	}
+
+	static inline Sum sub(const Sum& a, const Sum& b)
+	{
+		Sum s = { a.z - b.z, a.xz - b.xz, a.yz - b.yz, a.n - b.n };
+		return s;
+	}
+
+	// mean world position of a box sum, false if empty.
+	// (xc, yc) is the pixel the box belongs to
+	inline bool mean(int xc, int yc, const Sum& s, ofVec3f& v) const
+	{
+		if (s.n == 0) return false;
+
+		// sum of (x - xc) * z, exact after wrap around
+		const int32_t rel_xz = (int32_t)(s.xz - (uint32_t)xc * s.z);
+		const int32_t rel_yz = (int32_t)(s.yz - (uint32_t)yc * s.z);
+
+		// box sums of z and n fit in int32, which converts faster
+		const float Z = (int32_t)s.z;
+		const float k = intrinsics.depth_unit / (int32_t)s.n;
+
+		v.x = (rel_xz + (xc - intrinsics.cx) * Z) * intrinsics.inv_fx * k;
+		v.y = ((intrinsics.cy - yc) * Z - rel_yz) * intrinsics.inv_fy * k;
+		v.z = Z * k;
+
+		return true;
+	}
+
+	void computeNormals(int row0, int row1)
+	{
+		const int DS = downsampling_level;
+		const int cols = width / DS;
+		const int r = smoothing_size;
+		const int stride = width + 1;
+
+		// vertical strip sums of the current row: full window, above and below
+		Sum *strip = &scratch[(row0 / BAND) * stride * 3];
+		Sum *above = strip + stride;
+		Sum *below = above + stride;
+
+		vector<ofVec3f>& out = *dst;
+
+		for (int j = row0; j < row1; j++)
+		{
+			const int y = j * DS;
+			const int y0 = std::max(y - r, 0);
+			const int y1 = std::min(y + r + 1, height);
+
+			const Sum *I0 = &integral[y0 * stride];
+			const Sum *Iy = &integral[y * stride];
+			const Sum *Iy1 = &integral[(y + 1) * stride];
+			const Sum *I1 = &integral[y1 * stride];
+
+			for (int x = 0; x < stride; x++)
+			{
+				strip[x] = sub(I1[x], I0[x]);
+				above[x] = sub(Iy[x], I0[x]);
+				below[x] = sub(I1[x], Iy1[x]);
+			}
+
+			ofVec3f *n = &out[j * cols];
+			const unsigned short *depth_row = depth_pix + y * width;
+
+			for (int i = 0; i < cols; i++)
+			{
+				const int x = i * DS;
+				const int x0 = std::max(x - r, 0);
+				const int x1 = std::min(x + r + 1, width);
+
+				const unsigned short Z = depth_row[x];
+
+				ofVec3f left, right, up, down;
+
+				if (Z == 0
+					|| !mean(x, y, sub(strip[x], strip[x0]), left)
+					|| !mean(x, y, sub(strip[x1], strip[x + 1]), right)
+					|| !mean(x, y, sub(above[x1], above[x0]), up)
+					|| !mean(x, y, sub(below[x1], below[x0]), down))
+				{
+					n[i].set(0, 0, 0);
+					continue;
+				}
+
+				const float max_change = max_depth_change_factor * Z * intrinsics.depth_unit * r;
+
+				if (fabsf(right.z - left.z) > max_change
+					|| fabsf(down.z - up.z) > max_change)
+				{
+					n[i].set(0, 0, 0);
+					continue;
+				}
+
+				const ofVec3f dx = right - left;
+				const ofVec3f dy = down - up;
+				ofVec3f v = dy.getCrossed(dx);
+
+				const float len = v.length();
+				if (len == 0)
+				{
+					n[i].set(0, 0, 0);
+					continue;
+				}
+
+				// face the sensor
+				const float inv_len = (v.z > 0 ? -1.f : 1.f) / len;
+
+				// same space as MeshGenerator
+				n[i].set(v.x * inv_len, v.y * inv_len, -v.z * inv_len);
+			}
+		}
+	}
+};
@@ -0,0 +1,235 @@
+#pragma once
+
+#include "ofxNI2.h"
+#include "utils/AffineTransform.h"
+#include "utils/WorkerPool.h"
+
+namespace ofxNI2
+{
+	class PointCloudFusion;
+}
+
+// merges the depth of several sensors into one world space point buffer.
+// each sensor is converted on its own task straight into its slice of a
+// preallocated buffer, with near/far and bounding box culling done in the
+// same loop, so rejected points are never written.
+//
+// sensor space is the same as MeshGenerator's, the extrinsic matrix maps
+// it into world space (v * M, like ofMatrix4x4::preMult)
+
+class ofxNI2::PointCloudFusion
+{
+public:
+
+	PointCloudFusion() : num_points(0), pool(NULL) {}
+
+	// returns the sensor index, which is also the source id of its points
+	int addSensor(DepthStream& stream, const ofMatrix4x4& extrinsic = ofMatrix4x4())
+	{
+		Sensor s;
+		s.stream = &stream;
+		s.extrinsic = extrinsic;
+		sensors.push_back(s);
+		return sensors.size() - 1;
+	}
+
+	void clearSensors()
+	{
+		sensors.clear();
+		num_points = 0;
+	}
+
+	size_t getNumSensors() const { return sensors.size(); }
+
+	void setExtrinsic(int idx, const ofMatrix4x4& m) { sensors.at(idx).extrinsic = m; }
+	ofMatrix4x4 getExtrinsic(int idx) const { return sensors.at(idx).extrinsic; }
+
+	// in raw depth units of the sensor, 0 disables
+	void setClipping(int idx, int near_value, int far_value)
+	{
+		Sensor &s = sensors.at(idx);
+		s.near_value = near_value;
+		s.far_value = far_value;
+	}
+
+	// world space box, applied after the extrinsic
+	void setBounds(int idx, const ofVec3f& min_v, const ofVec3f& max_v)
+	{
+		Sensor &s = sensors.at(idx);
+		s.use_bounds = true;
+		s.bounds_min = min_v;
+		s.bounds_max = max_v;
+	}
+
+	void clearBounds(int idx) { sensors.at(idx).use_bounds = false; }
+
+	void setDownsamplingLevel(int idx, int level) { sensors.at(idx).downsampling_level = std::max(1, level); }
+
+	void update()
+	{
+		// slices are sized for the worst case, so the buffer only grows
+		// when a sensor changes resolution. the frame is taken here once,
+		// convert() must not see a different size than its slice has
+		int capacity = 0;
+
+		for (int i = 0; i < sensors.size(); i++)
+		{
+			Sensor &s = sensors[i];
+			const ofShortPixels &depth = s.stream->getPixelsRef();
+			const int DS = s.downsampling_level;
+
+			s.depth_pix = depth.getPixels();
+			s.width = depth.getWidth();
+			s.height = depth.getHeight();
+			s.timestamp = s.stream->getTimestamp();
+			s.num_points = 0;
+
+			s.offset = capacity;
+			if (s.depth_pix) capacity += (s.width / DS) * (s.height / DS);
+		}
+
+		if (points.size() < capacity)
+		{
+			points.resize(capacity);
+			source_ids.resize(capacity);
+		}
+
+		WorkerPool &p = pool ? *pool : WorkerPool::getShared();
+
+		Task task;
+		task.self = this;
+		p.run(task, 0, sensors.size(), 1);
+
+		// close the gaps between slices
+		num_points = 0;
+
+		for (int i = 0; i < sensors.size(); i++)
+		{
+			const Sensor &s = sensors[i];
+
+			if (s.offset != num_points && s.num_points > 0)
+			{
+				memmove(&points[num_points], &points[s.offset], sizeof(ofVec3f) * s.num_points);
+				memmove(&source_ids[num_points], &source_ids[s.offset], sizeof(unsigned short) * s.num_points);
+			}
+
+			num_points += s.num_points;
+		}
+	}
+
+	int getNumPoints() const { return num_points; }
+
+	// valid up to getNumPoints()
+	const ofVec3f* getPoints() const { return points.empty() ? NULL : &points[0]; }
+	const unsigned short* getSourceIds() const { return source_ids.empty() ? NULL : &source_ids[0]; }
+
+	// of the frame the sensor's points came from
+	uint64_t getTimestamp(int idx) const { return sensors.at(idx).timestamp; }
+	int getNumPoints(int idx) const { return sensors.at(idx).num_points; }
+
+	// NULL uses WorkerPool::getShared()
+	void setWorkerPool(WorkerPool *p) { pool = p; }
+
+protected:
+
+	struct Sensor
+	{
+		DepthStream *stream;
+		ofMatrix4x4 extrinsic;
+
+		int near_value, far_value;
+		bool use_bounds;
+		ofVec3f bounds_min, bounds_max;
+		int downsampling_level;
+
+		// the frame of the current update()
+		const unsigned short *depth_pix;
+		int width, height;
+
+		int offset;
+		int num_points;
+		uint64_t timestamp;
+
+		Sensor() : stream(NULL), near_value(0), far_value(0), use_bounds(false), downsampling_level(1), depth_pix(NULL), width(0), height(0), offset(0), num_points(0), timestamp(0) {}
+	};
+
+	class Task : public ParallelTask
+	{
+	public:
+
+		PointCloudFusion *self;
+
+		void run(int begin, int end)
+		{
+			for (int i = begin; i < end; i++)
+				self->convert(i);
+		}
+	};
+
+	vector<Sensor> sensors;
+
+	vector<ofVec3f> points;
+	vector<unsigned short> source_ids;
+	int num_points;
+
+	WorkerPool *pool;
+
+	void convert(int idx)
+	{
+		Sensor &s = sensors[idx];
+
+		const int W = s.width;
+		const int H = s.height;
+		const int DS = s.downsampling_level;
+
+		// no frame yet, the slice is empty
+		if (!s.depth_pix || W < DS || H < DS) return;
+
+		Intrinsics intrinsics = s.stream->getIntrinsics();
+		if (intrinsics.width != W || intrinsics.height != H)
+			intrinsics = intrinsics.getScaled(W, H);
+
+		const AffineTransform M(s.extrinsic);
+
+		const unsigned short near_value = ofClamp(s.near_value, 1, 65535);
+		const unsigned short far_value = s.far_value > 0 ? ofClamp(s.far_value, 1, 65535) : 65535;
+
+		const ofVec3f &bmin = s.bounds_min;
+		const ofVec3f &bmax = s.bounds_max;
+		const bool use_bounds = s.use_bounds;
+
+		const unsigned short *depth_pix = s.depth_pix;
+
+		ofVec3f *dst = &points[s.offset];
+		unsigned short *dst_id = &source_ids[s.offset];
+		int n = 0;
+
+		for (int y = 0; y + DS <= H; y += DS)
+		{
+			const unsigned short *row = depth_pix + y * W;
+
+			for (int x = 0; x + DS <= W; x += DS)
+			{
+				const unsigned short z = row[x];
+				if (z < near_value || z > far_value) continue;
+
+				float X, Y, Z;
+				intrinsics.unproject(x, y, z, X, Y, Z);
+
+				ofVec3f &v = dst[n];
+				M.apply(X, Y, -Z, v.x, v.y, v.z);
+
+				if (use_bounds
+					&& (v.x < bmin.x || v.x > bmax.x
+						|| v.y < bmin.y || v.y > bmax.y
+						|| v.z < bmin.z || v.z > bmax.z))
+					continue;
+
+				dst_id[n] = idx;
+				n++;
+			}
+		}
+
+		s.num_points = n;
+	}
+};
@@ -0,0 +1,394 @@
+#pragma once
+
+#include "utils/RecordingReader.h"
+
+#include "Poco/Event.h"
+#include "Poco/Environment.h"
+
+namespace ofxNI2
+{
+	class PrefetchReader;
+}
+
+// RecordingReader for playback. while one frame is used, worker threads
+// decode the next ones of every stream into preallocated buffers, earliest
+// timestamp first, so playing compressed depth and IR isn't bound by a
+// single core.
+//
+// the frames ahead follow the step between the last two requests, so
+// fast forward and reverse are prefetched too. a jump further than that
+// counts as a seek: the frames queued before are dropped and the frame
+// asked for is decoded right away.
+//
+// raw frames are still views of the file and need no workers. call from
+// one thread only.
+
+class ofxNI2::PrefetchReader
+{
+public:
+
+	PrefetchReader() : num_frames_ahead(8), num_hits(0), num_misses(0) {}
+	~PrefetchReader() { close(); }
+
+	// frames_ahead per stream. num_threads 0 means one less than the cores,
+	// the calling thread decodes on seeks
+	bool open(const string& path, int frames_ahead = 8, int num_threads = 0)
+	{
+		close();
+
+		if (!reader.open(path)) return false;
+
+		num_frames_ahead = std::max(frames_ahead, 1);
+
+		streams.resize(reader.getNumStreams());
+
+		for (int i = 0; i < streams.size(); i++)
+		{
+			StreamData &s = streams[i];
+			const recording::StreamHeader &h = reader.getStreamHeader(i);
+
+			s.last_frame = -1;
+			s.step = 1;
+			s.generation = 0;
+			s.in_use = -1;
+
+			if (!recording::isRvlFormat((openni::PixelFormat)h.pixel_format)) continue;
+
+			// the frame in use and the ones ahead
+			s.buffers.resize(num_frames_ahead + 1);
+
+			for (int j = 0; j < s.buffers.size(); j++)
+			{
+				s.buffers[j].pixels.allocate(h.width, h.height, 1);
+				s.buffers[j].state = FREE;
+			}
+		}
+
+		if (num_threads <= 0)
+			num_threads = std::max((int)Poco::Environment::processorCount() - 1, 1);
+
+		for (int i = 0; i < num_threads; i++)
+		{
+			Worker *w = new Worker(this);
+			w->startThread(true, false);
+			workers.push_back(w);
+		}
+
+		num_hits = num_misses = 0;
+
+		return true;
+	}
+
+	void close()
+	{
+		for (int i = 0; i < workers.size(); i++)
+			workers[i]->stopThread();
+
+		for (int i = 0; i < workers.size(); i++)
+		{
+			workers[i]->waitForThread(false);
+			delete workers[i];
+		}
+
+		workers.clear();
+		jobs.clear();
+		streams.clear();
+
+		reader.close();
+	}
+
+	bool isOpen() const { return reader.isOpen(); }
+
+	// for headers, timestamps and finding frames
+	const RecordingReader& getReader() const { return reader; }
+
+	int getNumStreams() const { return reader.getNumStreams(); }
+	int getNumFrames(int stream) const { return reader.getNumFrames(stream); }
+
+	int getNumFramesAhead() const { return num_frames_ahead; }
+
+	// same as RecordingReader::getShortPixels(), valid until the next call
+	// for the same stream
+	const ofShortPixels& getShortPixels(int stream, int frame)
+	{
+		StreamData &s = streams[stream];
+
+		if (s.buffers.empty())
+		{
+			s.last_frame = frame;
+			return reader.getShortPixels(stream, frame);
+		}
+
+		ofScopedLock lock(mutex);
+
+		const int step = frame - s.last_frame;
+
+		if (step != 0)
+		{
+			if (s.last_frame >= 0 && abs(step) <= num_frames_ahead) s.step = step;
+
+			// a seek, the frames ahead are the wrong ones
+			else discard(stream);
+
+			s.last_frame = frame;
+		}
+
+		if (!reader.needsDecoding(stream, frame))
+		{
+			prefetch(stream);
+			return reader.getShortPixels(stream, frame);
+		}
+
+		int b = findBuffer(s, frame);
+
+		if (b < 0)
+		{
+			num_misses++;
+
+			// workers never hold the buffer in use
+			b = s.in_use >= 0 ? s.in_use : findFreeBuffer(s);
+			assert(b >= 0);
+
+			Buffer &buf = s.buffers[b];
+			buf.frame = frame;
+			buf.generation = s.generation;
+			buf.state = DECODING;
+
+			mutex.unlock();
+			reader.decodeShortPixels(stream, frame, buf.pixels);
+			mutex.lock();
+
+			buf.state = READY;
+		}
+		else
+		{
+			if (s.buffers[b].state == READY) num_hits++;
+			else num_misses++;
+
+			while (s.buffers[b].state != READY)
+			{
+				mutex.unlock();
+				decoded.wait();
+				mutex.lock();
+			}
+		}
+
+		if (s.in_use >= 0 && s.in_use != b)
+			s.buffers[s.in_use].state = FREE;
+
+		s.in_use = b;
+
+		prefetch(stream);
+
+		return s.buffers[b].pixels;
+	}
+
+	// 8bit formats, always a view of the file
+	const ofPixels& getPixels(int stream, int frame)
+	{
+		streams[stream].last_frame = frame;
+		return reader.getPixels(stream, frame);
+	}
+
+	// frames that were decoded ahead when they were asked for, and frames
+	// that had to be waited for or decoded on the spot
+	int getNumHits() const { return num_hits; }
+	int getNumMisses() const { return num_misses; }
+
+protected:
+
+	enum State
+	{
+		FREE,
+		QUEUED,
+		DECODING,
+		READY
+	};
+
+	struct Buffer
+	{
+		ofShortPixels pixels;
+		int frame;
+		State state;
+
+		// of the stream when the buffer was queued
+		unsigned int generation;
+	};
+
+	struct StreamData
+	{
+		vector<Buffer> buffers;
+
+		int last_frame, step;
+
+		// bumped on seeks, jobs of older generations are dropped
+		unsigned int generation;
+
+		// the buffer returned last
+		int in_use;
+	};
+
+	struct Job
+	{
+		int stream;
+		int buffer;
+		uint64_t timestamp;
+	};
+
+	class Worker : public ofThread
+	{
+	public:
+
+		Worker(PrefetchReader *reader) : reader(reader) {}
+
+	protected:
+
+		PrefetchReader *reader;
+
+		void threadedFunction()
+		{
+			while (isThreadRunning())
+			{
+				// the timeout lets close() stop every worker with one event
+				if (!reader->decodeNext())
+					reader->job_queued.tryWait(100);
+			}
+		}
+	};
+
+	RecordingReader reader;
+	int num_frames_ahead;
+
+	vector<StreamData> streams;
+	vector<Worker*> workers;
+
+	// guards streams and jobs
+	ofMutex mutex;
+	vector<Job> jobs;
+
+	Poco::Event job_queued, decoded;
+
+	int num_hits, num_misses;
+
+	int findBuffer(const StreamData &s, int frame) const
+	{
+		for (int i = 0; i < s.buffers.size(); i++)
+		{
+			const Buffer &b = s.buffers[i];
+			if (b.state != FREE && b.frame == frame && b.generation == s.generation) return i;
+		}
+		return -1;
+	}
+
+	int findFreeBuffer(const StreamData &s) const
+	{
+		for (int i = 0; i < s.buffers.size(); i++)
+			if (s.buffers[i].state == FREE && i != s.in_use) return i;
+		return -1;
+	}
+
+	// buffers being decoded are freed by their worker
+	void discard(int stream)
+	{
+		StreamData &s = streams[stream];
+		s.generation++;
+
+		for (int i = 0; i < s.buffers.size(); i++)
+		{
+			Buffer &b = s.buffers[i];
+			if (i != s.in_use && (b.state == QUEUED || b.state == READY)) b.state = FREE;
+		}
+
+		for (int i = jobs.size() - 1; i >= 0; i--)
+			if (jobs[i].stream == stream) jobs.erase(jobs.begin() + i);
+	}
+
+	// queues the frames after the last one in the direction of playback
+	void prefetch(int stream)
+	{
+		StreamData &s = streams[stream];
+		const int num_frames = reader.getNumFrames(stream);
+
+		// buffers behind the playback position are of no use anymore
+		for (int i = 0; i < s.buffers.size(); i++)
+		{
+			Buffer &b = s.buffers[i];
+			if (i == s.in_use || b.state != READY) continue;
+
+			const int ahead = (b.frame - s.last_frame) / s.step;
+			if ((b.frame - s.last_frame) % s.step != 0 || ahead <= 0 || ahead > num_frames_ahead)
+				b.state = FREE;
+		}
+
+		bool queued = false;
+
+		for (int i = 1; i <= num_frames_ahead; i++)
+		{
+			const int frame = s.last_frame + i * s.step;
+			if (frame < 0 || frame >= num_frames) break;
+
+			// raw frames are views, their buffers are kept for the others
+			if (!reader.needsDecoding(stream, frame) || findBuffer(s, frame) >= 0) continue;
+
+			const int b = findFreeBuffer(s);
+			if (b < 0) break;
+
+			Buffer &buf = s.buffers[b];
+			buf.frame = frame;
+			buf.generation = s.generation;
+			buf.state = QUEUED;
+
+			Job job;
+			job.stream = stream;
+			job.buffer = b;
+			job.timestamp = reader.getTimestamp(stream, frame);
+			jobs.push_back(job);
+
+			queued = true;
+		}
+
+		if (queued) job_queued.set();
+	}
+
+	// worker threads, false if there was nothing to do
+	bool decodeNext()
+	{
+		mutex.lock();
+
+		if (jobs.empty())
+		{
+			mutex.unlock();
+			return false;
+		}
+
+		// streams are decoded in playback order
+		int next = 0;
+		for (int i = 1; i < jobs.size(); i++)
+			if (jobs[i].timestamp < jobs[next].timestamp) next = i;
+
+		const Job job = jobs[next];
+		jobs.erase(jobs.begin() + next);
+
+		// wakes another worker for the rest
+		if (!jobs.empty()) job_queued.set();
+
+		StreamData &s = streams[job.stream];
+		Buffer &buf = s.buffers[job.buffer];
+
+		const int frame = buf.frame;
+		const unsigned int generation = buf.generation;
+		buf.state = DECODING;
+
+		mutex.unlock();
+
+		reader.decodeShortPixels(job.stream, frame, buf.pixels);
+
+		mutex.lock();
+		buf.state = generation == s.generation ? READY : FREE;
+		mutex.unlock();
+
+		decoded.set();
+
+		return true;
+	}
+};
@@ -0,0 +1,183 @@
+#pragma once
+
+#include "ofMain.h"
+#include "OpenNI.h"
+
+#include "utils/Intrinsics.h"
+
+namespace ofxNI2
+{
+	namespace recording
+	{
+		struct FileHeader;
+		struct StreamHeader;
+		struct FrameHeader;
+		struct IndexEntry;
+		struct Footer;
+	}
+}
+
+// on disk layout of FrameRecorder files, little endian:
+//
+//   FileHeader
+//   StreamHeader * num_streams
+//   padding
+//   (FrameHeader payload padding) * n
+//   IndexEntry * n
+//   Footer
+//
+// payload is payload_size bytes, raw_size bytes once decoded with codec.
+// headers and frame chunks start at multiples of CHUNK_ALIGNMENT, and so
+// do payloads because FrameHeader is exactly that size. the index at the
+// end is written when recording stops, a file without one can still be
+// read by walking the chunks.
+//
+// segmented recordings have a text manifest, MANIFEST_HEADER on the first
+// line and then a line per segment file, relative to the manifest:
+//
+//   file num_frames first_timestamp last_timestamp
+
+namespace ofxNI2
+{
+	namespace recording
+	{
+		enum
+		{
+			FILE_MAGIC = 0x5232494E, // "NI2R"
+			FRAME_MAGIC = 0x454D5246, // "FRME"
+			INDEX_MAGIC = 0x58444E49, // "INDX"
+			VERSION = 2,
+
+			CHUNK_ALIGNMENT = 64
+		};
+
+		const char * const MANIFEST_HEADER = "NI2M 1";
+
+		inline uint64_t align(uint64_t offset)
+		{
+			return (offset + CHUNK_ALIGNMENT - 1) & ~(uint64_t)(CHUNK_ALIGNMENT - 1);
+		}
+
+		enum Codec
+		{
+			CODEC_RAW = 0,
+			CODEC_RVL = 1
+		};
+
+		// bytes per pixel of the formats OpenNI devices deliver
+		inline int getBytesPerPixel(openni::PixelFormat format)
+		{
+			switch (format)
+			{
+				case openni::PIXEL_FORMAT_DEPTH_1_MM:
+				case openni::PIXEL_FORMAT_DEPTH_100_UM:
+				case openni::PIXEL_FORMAT_SHIFT_9_2:
+				case openni::PIXEL_FORMAT_SHIFT_9_3:
+				case openni::PIXEL_FORMAT_GRAY16:
+				case openni::PIXEL_FORMAT_YUV422:
+					return 2;
+				case openni::PIXEL_FORMAT_RGB888:
+					return 3;
+				case openni::PIXEL_FORMAT_GRAY8:
+					return 1;
+				default:
+					return 0;
+			}
+		}
+
+		// RVL only makes sense for single channel 16bit frames
+		inline bool isRvlFormat(openni::PixelFormat format)
+		{
+			return format == openni::PIXEL_FORMAT_DEPTH_1_MM
+				|| format == openni::PIXEL_FORMAT_DEPTH_100_UM
+				|| format == openni::PIXEL_FORMAT_GRAY16;
+		}
+	}
+}
+
+struct ofxNI2::recording::FileHeader
+{
+	uint32_t magic;
+	uint32_t version;
+	uint32_t num_streams;
+	uint32_t reserved;
+};
+
+struct ofxNI2::recording::StreamHeader
+{
+	uint32_t sensor_type;
+	uint32_t pixel_format;
+	uint32_t width, height;
+	uint32_t fps;
+
+	// Intrinsics, all 0 if unknown
+	float fx, fy, cx, cy;
+	float depth_unit;
+};
+
+struct ofxNI2::recording::FrameHeader
+{
+	uint32_t magic;
+	uint32_t stream;
+	uint32_t codec;
+	uint32_t frame_index;
+	uint64_t timestamp;
+	uint32_t width, height;
+	uint32_t raw_size;
+	uint32_t payload_size;
+
+	// 16bit values were stored shifted right by this many bits
+	uint32_t depth_shift;
+
+	// pads the header to CHUNK_ALIGNMENT
+	uint32_t reserved[5];
+};
+
+namespace ofxNI2
+{
+	namespace recording
+	{
+		// the header every writer puts in a file, intrinsics are optional
+		inline StreamHeader makeStreamHeader(openni::SensorType type, openni::PixelFormat format, int width, int height, int fps, const Intrinsics& intrinsics = Intrinsics())
+		{
+			StreamHeader h;
+			memset(&h, 0, sizeof(h));
+
+			h.sensor_type = type;
+			h.pixel_format = format;
+			h.width = width;
+			h.height = height;
+			h.fps = fps;
+
+			if (intrinsics.isValid())
+			{
+				h.fx = intrinsics.fx;
+				h.fy = intrinsics.fy;
+				h.cx = intrinsics.cx;
+				h.cy = intrinsics.cy;
+				h.depth_unit = intrinsics.depth_unit;
+			}
+
+			return h;
+		}
+	}
+}
+
+struct ofxNI2::recording::IndexEntry
+{
+	// of the FrameHeader
+	uint64_t offset;
+	uint64_t timestamp;
+	uint32_t stream;
+	uint32_t frame_index;
+	uint32_t codec;
+	uint32_t payload_size;
+};
+
+// last bytes of the file
+struct ofxNI2::recording::Footer
+{
+	uint64_t index_offset;
+	uint32_t num_entries;
+	uint32_t magic;
+};
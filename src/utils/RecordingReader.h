@@ -0,0 +1,450 @@
+#pragma once
+
+#include "ofxNI2.h"
+#include "utils/RecordingFormat.h"
+#include "utils/RvlCodec.h"
+
+#include <fstream>
+
+#ifdef TARGET_WIN32
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+namespace ofxNI2
+{
+	class RecordingReader;
+}
+
+// random access to FrameRecorder files. the file is memory mapped and its
+// index is split into a table per stream, so finding a frame by number or
+// timestamp is a lookup or a binary search, and frames stored raw are
+// returned without copying. RVL frames are decoded into a buffer per
+// stream.
+//
+// open() also takes the manifest of a segmented recording, then all
+// segments are mapped and read as one recording. segments that can't be
+// read, like an empty one left by a crash, are skipped with a warning.
+//
+// each file is mapped at once, long recordings need a 64bit build.
+
+class ofxNI2::RecordingReader
+{
+public:
+
+	RecordingReader() {}
+	~RecordingReader() { close(); }
+
+	bool open(const string& path)
+	{
+		close();
+
+		const string full_path = ofToDataPath(path);
+
+		vector<string> files;
+
+		const bool is_manifest = readManifest(full_path, files);
+		if (!is_manifest) files.push_back(full_path);
+
+		for (int i = 0; i < files.size(); i++)
+		{
+			if (openSegment(files[i])) continue;
+
+			if (!is_manifest) return fail("can't read " + files[i]);
+			ofLogWarning("ofxNI2::RecordingReader") << "can't read " << files[i] << ", skipped";
+		}
+
+		if (segments.empty()) return fail("no readable segment in " + full_path);
+
+		// binary search needs sorted timestamps, the order is kept otherwise
+		for (int i = 0; i < streams.size(); i++)
+			std::stable_sort(streams[i].frames.begin(), streams[i].frames.end(), TimestampLess());
+
+		return true;
+	}
+
+	void close()
+	{
+		for (int i = 0; i < segments.size(); i++)
+			unmap(segments[i]);
+
+		segments.clear();
+		streams.clear();
+	}
+
+	bool isOpen() const { return !segments.empty(); }
+
+	int getNumSegments() const { return segments.size(); }
+
+	int getNumStreams() const { return streams.size(); }
+
+	const recording::StreamHeader& getStreamHeader(int stream) const { return streams[stream].header; }
+
+	// first stream of this sensor type, -1 if there is none
+	int findStream(openni::SensorType type) const
+	{
+		for (int i = 0; i < streams.size(); i++)
+			if (streams[i].header.sensor_type == type) return i;
+		return -1;
+	}
+
+	// invalid if the stream was recorded without
+	Intrinsics getIntrinsics(int stream) const
+	{
+		const recording::StreamHeader &h = streams[stream].header;
+
+		Intrinsics o;
+		if (h.fx > 0) o.setup(h.width, h.height, h.fx, h.fy, h.cx, h.cy, h.depth_unit);
+		return o;
+	}
+
+	int getNumFrames(int stream) const { return streams[stream].frames.size(); }
+
+	uint64_t getTimestamp(int stream, int frame) const { return streams[stream].frames[frame].timestamp; }
+
+	// frame index from the device
+	int getFrameIndex(int stream, int frame) const { return getFrameHeader(stream, frame).frame_index; }
+
+	// the last frame at or before timestamp, 0 if it's before the first one
+	// and -1 if the stream has no frames
+	int findFrame(int stream, uint64_t timestamp) const
+	{
+		const vector<Frame> &frames = streams[stream].frames;
+		if (frames.empty()) return -1;
+
+		Frame key;
+		key.timestamp = timestamp;
+
+		const int i = std::upper_bound(frames.begin(), frames.end(), key, TimestampLess()) - frames.begin();
+		return std::max(i - 1, 0);
+	}
+
+	const recording::FrameHeader& getFrameHeader(int stream, int frame) const
+	{
+		return *(const recording::FrameHeader*)streams[stream].frames[frame].chunk;
+	}
+
+	// the stored bytes, encoded as getFrameHeader().codec says
+	const unsigned char* getPayload(int stream, int frame) const
+	{
+		return streams[stream].frames[frame].chunk + sizeof(recording::FrameHeader);
+	}
+
+	// 16bit formats. raw frames are a view of the file, RVL frames are
+	// decoded. valid until the next call for the same stream
+	const ofShortPixels& getShortPixels(int stream, int frame)
+	{
+		StreamData &s = streams[stream];
+		assert(recording::getBytesPerPixel((openni::PixelFormat)s.header.pixel_format) == 2);
+
+		if (s.cached_frame == frame) return *s.short_pixels;
+
+		if (!needsDecoding(stream, frame))
+		{
+			const recording::FrameHeader &h = getFrameHeader(stream, frame);
+			s.short_view.setFromExternalPixels((unsigned short*)getPayload(stream, frame), h.width, h.height, 1);
+			s.short_pixels = &s.short_view;
+		}
+		else
+		{
+			decodeShortPixels(stream, frame, s.short_decoded);
+			s.short_pixels = &s.short_decoded;
+		}
+
+		s.cached_frame = frame;
+		return *s.short_pixels;
+	}
+
+	// false if getShortPixels() returns a view of the file
+	bool needsDecoding(int stream, int frame) const
+	{
+		const recording::FrameHeader &h = getFrameHeader(stream, frame);
+		return h.codec != recording::CODEC_RAW || h.depth_shift != 0 || h.payload_size < h.width * h.height * 2;
+	}
+
+	// into pixels, which is reallocated if the size differs. thread safe,
+	// unlike the getters with a cache
+	bool decodeShortPixels(int stream, int frame, ofShortPixels &pixels) const
+	{
+		const recording::FrameHeader &h = getFrameHeader(stream, frame);
+		const unsigned char *payload = getPayload(stream, frame);
+
+		if (pixels.getWidth() != h.width || pixels.getHeight() != h.height)
+			pixels.allocate(h.width, h.height, 1);
+
+		const int n = h.width * h.height;
+		unsigned short *dst = pixels.getPixels();
+
+		bool ok;
+		if (h.codec == recording::CODEC_RVL)
+			ok = RvlCodec::decompress(payload, h.payload_size, dst, n);
+		else if ((ok = h.codec == recording::CODEC_RAW && h.payload_size >= n * 2))
+			memcpy(dst, payload, n * 2);
+
+		if (!ok)
+		{
+			ofLogError("ofxNI2::RecordingReader") << "broken frame " << frame << " in stream " << stream;
+			pixels.set(0);
+			return false;
+		}
+
+		// frames FrameRecorder::DOWNGRADE stored with fewer bits
+		if (h.depth_shift > 0)
+			for (int i = 0; i < n; i++)
+				dst[i] <<= h.depth_shift;
+
+		return true;
+	}
+
+	// 8bit formats, one byte per channel. always a view of the file
+	const ofPixels& getPixels(int stream, int frame)
+	{
+		StreamData &s = streams[stream];
+		const int channels = recording::getBytesPerPixel((openni::PixelFormat)s.header.pixel_format);
+		assert(channels > 0 && !recording::isRvlFormat((openni::PixelFormat)s.header.pixel_format));
+
+		if (s.cached_frame != frame)
+		{
+			const recording::FrameHeader &h = getFrameHeader(stream, frame);
+			s.pixels.setFromExternalPixels((unsigned char*)getPayload(stream, frame), h.width, h.height, channels);
+			s.cached_frame = frame;
+		}
+
+		return s.pixels;
+	}
+
+protected:
+
+	struct Segment
+	{
+		const unsigned char *data;
+		uint64_t size;
+	};
+
+	struct Frame
+	{
+		uint64_t timestamp;
+
+		// the FrameHeader in the mapping
+		const unsigned char *chunk;
+	};
+
+	struct StreamData
+	{
+		recording::StreamHeader header;
+		vector<Frame> frames;
+
+		int cached_frame;
+		ofShortPixels short_view, short_decoded;
+		ofShortPixels *short_pixels;
+		ofPixels pixels;
+	};
+
+	struct TimestampLess
+	{
+		bool operator()(const Frame &a, const Frame &b) const { return a.timestamp < b.timestamp; }
+	};
+
+	vector<Segment> segments;
+	vector<StreamData> streams;
+
+	bool fail(const string& message)
+	{
+		ofLogError("ofxNI2::RecordingReader") << message;
+		close();
+		return false;
+	}
+
+	// false if path isn't a manifest
+	bool readManifest(const string& path, vector<string>& files)
+	{
+		std::ifstream in(path.c_str());
+
+		string line;
+		if (!std::getline(in, line) || line != recording::MANIFEST_HEADER) return false;
+
+		const size_t slash = path.find_last_of("/\\");
+		const string dir = slash == string::npos ? "" : path.substr(0, slash + 1);
+
+		while (std::getline(in, line))
+		{
+			std::istringstream ss(line);
+
+			string file;
+			if (ss >> file) files.push_back(dir + file);
+		}
+
+		return true;
+	}
+
+	bool openSegment(const string& path)
+	{
+		Segment seg;
+		if (!map(path, seg)) return false;
+
+		uint64_t headers_size;
+
+		if (!readHeaders(seg, headers_size))
+		{
+			unmap(seg);
+			return false;
+		}
+
+		segments.push_back(seg);
+
+		if (!loadIndex(seg))
+		{
+			ofLogWarning("ofxNI2::RecordingReader") << "no index, scanning " << path;
+			scan(seg, recording::align(headers_size));
+		}
+
+		return true;
+	}
+
+	// the first readable segment sets up the streams, the others must
+	// continue them
+	bool readHeaders(const Segment &seg, uint64_t &headers_size)
+	{
+		if (seg.size < sizeof(recording::FileHeader))
+			return false;
+
+		const recording::FileHeader &fh = *(const recording::FileHeader*)seg.data;
+
+		if (fh.magic != recording::FILE_MAGIC || fh.version != recording::VERSION)
+			return false;
+
+		headers_size = sizeof(recording::FileHeader) + sizeof(recording::StreamHeader) * (uint64_t)fh.num_streams;
+		if (headers_size > seg.size)
+			return false;
+
+		const recording::StreamHeader *sh = (const recording::StreamHeader*)(seg.data + sizeof(recording::FileHeader));
+
+		if (segments.empty())
+		{
+			streams.resize(fh.num_streams);
+			for (int i = 0; i < streams.size(); i++)
+			{
+				streams[i].header = sh[i];
+				streams[i].cached_frame = -1;
+			}
+		}
+		else
+		{
+			// segments continue the same streams
+			if (fh.num_streams != streams.size()) return false;
+
+			for (int i = 0; i < streams.size(); i++)
+				if (sh[i].pixel_format != streams[i].header.pixel_format) return false;
+		}
+
+		return true;
+	}
+
+	// the footer written by RecordingWriter::close()
+	bool loadIndex(const Segment &seg)
+	{
+		if (seg.size < sizeof(recording::Footer)) return false;
+
+		const recording::Footer &footer = *(const recording::Footer*)(seg.data + seg.size - sizeof(recording::Footer));
+		if (footer.magic != recording::INDEX_MAGIC) return false;
+
+		const uint64_t index_size = sizeof(recording::IndexEntry) * (uint64_t)footer.num_entries;
+		if (footer.index_offset + index_size + sizeof(recording::Footer) != seg.size) return false;
+
+		const recording::IndexEntry *e = (const recording::IndexEntry*)(seg.data + footer.index_offset);
+
+		for (int i = 0; i < footer.num_entries; i++)
+			addFrame(seg, e[i].stream, e[i].timestamp, e[i].offset, e[i].payload_size, footer.index_offset);
+
+		return true;
+	}
+
+	// walks the chunks of a file that wasn't closed, up to the first broken one
+	void scan(const Segment &seg, uint64_t offset)
+	{
+		while (offset + sizeof(recording::FrameHeader) <= seg.size)
+		{
+			const recording::FrameHeader &h = *(const recording::FrameHeader*)(seg.data + offset);
+			if (h.magic != recording::FRAME_MAGIC) break;
+
+			if (!addFrame(seg, h.stream, h.timestamp, offset, h.payload_size, seg.size)) break;
+
+			offset = recording::align(offset + sizeof(h) + h.payload_size);
+		}
+	}
+
+	// false if the chunk isn't within [0, end)
+	bool addFrame(const Segment &seg, uint32_t stream, uint64_t timestamp, uint64_t offset, uint32_t payload_size, uint64_t end)
+	{
+		if (stream >= streams.size()
+			|| offset + sizeof(recording::FrameHeader) + payload_size > end)
+			return false;
+
+		Frame f;
+		f.timestamp = timestamp;
+		f.chunk = seg.data + offset;
+
+		streams[stream].frames.push_back(f);
+		return true;
+	}
+
+	static bool map(const string& path, Segment &seg)
+	{
+		seg.data = NULL;
+		seg.size = 0;
+
+#ifdef TARGET_WIN32
+		HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+		if (file == INVALID_HANDLE_VALUE) return false;
+
+		LARGE_INTEGER file_size;
+		HANDLE mapping = NULL;
+
+		if (GetFileSizeEx(file, &file_size) && file_size.QuadPart > 0)
+			mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+
+		CloseHandle(file);
+		if (!mapping) return false;
+
+		// the view keeps the mapping alive
+		seg.data = (const unsigned char*)MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+		CloseHandle(mapping);
+
+		if (seg.data) seg.size = file_size.QuadPart;
+#else
+		const int fd = ::open(path.c_str(), O_RDONLY);
+		if (fd < 0) return false;
+
+		struct stat st;
+		void *p = MAP_FAILED;
+
+		if (fstat(fd, &st) == 0 && st.st_size > 0)
+			p = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+
+		::close(fd);
+		if (p == MAP_FAILED) return false;
+
+		seg.data = (const unsigned char*)p;
+		seg.size = st.st_size;
+#endif
+		return seg.data != NULL;
+	}
+
+	static void unmap(Segment &seg)
+	{
+		if (!seg.data) return;
+
+#ifdef TARGET_WIN32
+		UnmapViewOfFile(seg.data);
+#else
+		munmap((void*)seg.data, seg.size);
+#endif
+
+		seg.data = NULL;
+		seg.size = 0;
+	}
+};
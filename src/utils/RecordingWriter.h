@@ -0,0 +1,145 @@
+#pragma once
+
+#include "ofMain.h"
+#include "utils/RecordingFormat.h"
+#include "utils/RvlCodec.h"
+
+namespace ofxNI2
+{
+	class RecordingWriter;
+}
+
+// writes the chunks and the index of a recording file, see
+// RecordingFormat.h. not thread safe, FrameRecorder and ReplayBuffer call
+// it from their writer threads.
+
+class ofxNI2::RecordingWriter
+{
+public:
+
+	RecordingWriter() : file(NULL), offset(0) {}
+	~RecordingWriter() { close(); }
+
+	bool open(const string& path, const vector<recording::StreamHeader>& streams)
+	{
+		close();
+
+		file = fopen(ofToDataPath(path).c_str(), "wb");
+		if (!file)
+		{
+			ofLogError("ofxNI2::RecordingWriter") << "can't open " << path;
+			return false;
+		}
+
+		setvbuf(file, NULL, _IOFBF, 1 << 20);
+
+		recording::FileHeader fh;
+		fh.magic = recording::FILE_MAGIC;
+		fh.version = recording::VERSION;
+		fh.num_streams = streams.size();
+		fh.reserved = 0;
+
+		fwrite(&fh, sizeof(fh), 1, file);
+		if (!streams.empty())
+			fwrite(&streams[0], sizeof(recording::StreamHeader), streams.size(), file);
+
+		offset = writePadding(sizeof(fh) + sizeof(recording::StreamHeader) * streams.size());
+		index.clear();
+
+		return true;
+	}
+
+	// writes the index, the file is unreadable without it until scanned
+	void close()
+	{
+		if (!file) return;
+
+		recording::Footer footer;
+		footer.index_offset = offset;
+		footer.num_entries = index.size();
+		footer.magic = recording::INDEX_MAGIC;
+
+		if (!index.empty())
+			fwrite(&index[0], sizeof(recording::IndexEntry), index.size(), file);
+		fwrite(&footer, sizeof(footer), 1, file);
+
+		offset += sizeof(recording::IndexEntry) * index.size() + sizeof(footer);
+
+		fclose(file);
+		file = NULL;
+	}
+
+	bool isOpen() const { return file != NULL; }
+
+	// bytes written so far
+	uint64_t getSize() const { return offset; }
+
+	int getNumFrames() const { return index.size(); }
+
+	// header needs stream, frame_index, timestamp, size and codec.
+	// returns the bytes written
+	size_t write(const recording::FrameHeader& header, const void *payload)
+	{
+		recording::FrameHeader h = header;
+		h.magic = recording::FRAME_MAGIC;
+		memset(h.reserved, 0, sizeof(h.reserved));
+
+		fwrite(&h, sizeof(h), 1, file);
+		if (h.payload_size) fwrite(payload, 1, h.payload_size, file);
+
+		recording::IndexEntry e;
+		e.offset = offset;
+		e.timestamp = h.timestamp;
+		e.stream = h.stream;
+		e.frame_index = h.frame_index;
+		e.codec = h.codec;
+		e.payload_size = h.payload_size;
+		index.push_back(e);
+
+		const uint64_t begin = offset;
+		offset = writePadding(offset + sizeof(h) + h.payload_size);
+
+		return offset - begin;
+	}
+
+	// picks the codec for a frame of raw_size bytes and sets codec and
+	// payload_size in h. returns data or the encoded frame in buffer
+	static const unsigned char* encode(const recording::StreamHeader& stream, recording::FrameHeader& h, const unsigned char *data, vector<unsigned char>& buffer)
+	{
+		h.codec = recording::CODEC_RAW;
+		h.payload_size = h.raw_size;
+
+		if (!recording::isRvlFormat((openni::PixelFormat)stream.pixel_format) || h.raw_size == 0)
+			return data;
+
+		const int num_pixels = h.width * h.height;
+		buffer.resize(RvlCodec::getMaxCompressedSize(num_pixels));
+
+		const size_t size = RvlCodec::compress((const unsigned short*)data, num_pixels, &buffer[0]);
+
+		// noise can make RVL larger than raw
+		if (size >= h.raw_size) return data;
+
+		h.codec = recording::CODEC_RVL;
+		h.payload_size = size;
+		return &buffer[0];
+	}
+
+protected:
+
+	FILE *file;
+	uint64_t offset;
+
+	vector<recording::IndexEntry> index;
+
+	// pads the file from offset to the next chunk boundary
+	uint64_t writePadding(uint64_t offset)
+	{
+		static const unsigned char zeros[recording::CHUNK_ALIGNMENT] = {0};
+
+		const uint64_t aligned = recording::align(offset);
+		if (aligned != offset) fwrite(zeros, 1, aligned - offset, file);
+
+		return aligned;
+	}
+};
@@ -0,0 +1,390 @@
+#pragma once
+
+#include "ofxNI2.h"
+#include "utils/RecordingWriter.h"
+
+namespace ofxNI2
+{
+	class ReplayBuffer;
+}
+
+// instant replay: keeps the last minutes of Depth/Ir/ColorStream frames in
+// memory and writes them to a recording file on request.
+//
+// frames are encoded like FrameRecorder does it as they arrive, and
+// appended to fixed size blocks within the memory budget. when all blocks
+// are used, the oldest one is recycled. dumpReplay() hands the current
+// blocks to a writer thread, which releases each block as soon as it's on
+// disk, so capture goes on while dumping. only if a dump holds all blocks
+// at once new frames are dropped.
+//
+// dumped files are read with RecordingReader.
+
+class ofxNI2::ReplayBuffer : public ofxNI2::FrameListener
+{
+public:
+
+	enum
+	{
+		// also the largest frame, 1280x1024 RGB fits
+		BLOCK_SIZE = 4 << 20
+	};
+
+	ReplayBuffer() : current(-1), num_frames(0), num_dropped(0), newest_timestamp(0), dumping(false), dumper(this) {}
+
+	~ReplayBuffer()
+	{
+		for (int i = 0; i < sources.size(); i++)
+			if (sources[i]) sources[i]->removeFrameListener(this);
+
+		dumper.waitForThread(false);
+	}
+
+	// memory for the frames, at least two blocks
+	void setup(int megabytes = 256)
+	{
+		waitForDump();
+
+		ofScopedLock lock(mutex);
+
+		const int num_blocks = std::max<uint64_t>(((uint64_t)megabytes << 20) / BLOCK_SIZE, 2);
+
+		blocks.clear();
+		blocks.resize(num_blocks);
+
+		for (int i = 0; i < num_blocks; i++)
+			blocks[i].data.resize(BLOCK_SIZE);
+
+		resetBlocks();
+	}
+
+	// frames are captured from now on, add all streams before they start.
+	// returns the stream index
+	int addStream(Stream &stream)
+	{
+		const openni::VideoStream &s = stream.get();
+		const openni::VideoMode mode = s.getVideoMode();
+
+		const int index = addStream(s.getSensorInfo().getSensorType(), mode.getPixelFormat(), mode.getResolutionX(), mode.getResolutionY(), mode.getFps(), stream.getIntrinsics());
+
+		sources.resize(index + 1, NULL);
+		sources[index] = &stream;
+
+		stream.addFrameListener(this);
+
+		return index;
+	}
+
+	// for frames passed in with addFrame()
+	int addStream(openni::SensorType type, openni::PixelFormat format, int width, int height, int fps = 30, const Intrinsics& intrinsics = Intrinsics())
+	{
+		ofScopedLock lock(mutex);
+
+		stream_headers.push_back(recording::makeStreamHeader(type, format, width, height, fps, intrinsics));
+		streams.push_back(StreamData());
+
+		return stream_headers.size() - 1;
+	}
+
+	// thread safe, one thread per stream. stride 0 means tightly packed
+	// rows. false if the frame was dropped
+	bool addFrame(int stream, const void *data, int width, int height, uint64_t timestamp, int frame_index = -1, int stride = 0)
+	{
+		assert(stream >= 0 && stream < stream_headers.size());
+
+		StreamData &sd = streams[stream];
+		const recording::StreamHeader &sh = stream_headers[stream];
+
+		const int bpp = recording::getBytesPerPixel((openni::PixelFormat)sh.pixel_format);
+		const int row_size = width * bpp;
+		if (stride == 0) stride = row_size;
+
+		const unsigned char *src = (const unsigned char*)data;
+
+		if (stride != row_size)
+		{
+			sd.packed.resize(row_size * height);
+			for (int y = 0; y < height; y++)
+				memcpy(&sd.packed[y * row_size], src + y * stride, row_size);
+			src = &sd.packed[0];
+		}
+
+		recording::FrameHeader h;
+		memset(&h, 0, sizeof(h));
+		h.magic = recording::FRAME_MAGIC;
+		h.stream = stream;
+		h.frame_index = frame_index < 0 ? sd.frame_counter : frame_index;
+		h.timestamp = timestamp;
+		h.width = width;
+		h.height = height;
+		h.raw_size = row_size * height;
+
+		sd.frame_counter++;
+
+		// encoding happens outside the lock, on the capture thread of the stream
+		const unsigned char *payload = RecordingWriter::encode(sh, h, src, sd.encoded);
+
+		const size_t chunk_size = recording::align(sizeof(h) + h.payload_size);
+
+		ofScopedLock lock(mutex);
+
+		if (blocks.empty() || chunk_size > BLOCK_SIZE || !reserve(chunk_size))
+		{
+			num_dropped++;
+			return false;
+		}
+
+		Block &b = blocks[current];
+		memcpy(&b.data[b.used], &h, sizeof(h));
+		memcpy(&b.data[b.used + sizeof(h)], payload, h.payload_size);
+		b.used += chunk_size;
+		b.num_frames++;
+
+		num_frames++;
+		newest_timestamp = std::max(newest_timestamp, timestamp);
+
+		return true;
+	}
+
+	// writes the last seconds of frames, or all of them with 0, on a
+	// background thread. false while a dump is still running
+	bool dumpReplay(const string& path, float seconds = 0)
+	{
+		if (isDumping()) return false;
+		dumper.waitForThread(false);
+
+		if (blocks.empty()) return false;
+
+		// streams are all added before capture starts, so the file is
+		// opened without holding up the capture threads
+		if (!dump_file.open(path, stream_headers)) return false;
+
+		ofScopedLock lock(mutex);
+
+		// the dump holds a reference until the block is written
+		dump_blocks.assign(ring.begin(), ring.end());
+		for (int i = 0; i < dump_blocks.size(); i++)
+			blocks[dump_blocks[i]].refs++;
+
+		// the block being filled is copied up to here
+		dump_current_used = current >= 0 ? blocks[current].used : 0;
+
+		dump_after = 0;
+		if (seconds > 0 && newest_timestamp > seconds * 1000000)
+			dump_after = newest_timestamp - (uint64_t)(seconds * 1000000);
+
+		dumping = true;
+		dumper.startThread(true, false);
+
+		return true;
+	}
+
+	bool isDumping() { ofScopedLock lock(mutex); return dumping; }
+	void waitForDump() { dumper.waitForThread(false); }
+
+	// drops all frames
+	void clear()
+	{
+		waitForDump();
+
+		ofScopedLock lock(mutex);
+		resetBlocks();
+	}
+
+	// frames in memory
+	int getNumFrames() { ofScopedLock lock(mutex); return num_frames; }
+	unsigned int getNumDropped() { ofScopedLock lock(mutex); return num_dropped; }
+
+	// seconds between the oldest and the newest frame in memory
+	float getDuration()
+	{
+		ofScopedLock lock(mutex);
+
+		if (ring.empty() || blocks[ring.front()].num_frames == 0) return 0;
+
+		const recording::FrameHeader &oldest = *(const recording::FrameHeader*)&blocks[ring.front()].data[0];
+		return (newest_timestamp - oldest.timestamp) / 1000000.0;
+	}
+
+	size_t getMemoryBudget() const { return blocks.size() * (size_t)BLOCK_SIZE; }
+
+	size_t getMemoryUsed()
+	{
+		ofScopedLock lock(mutex);
+
+		size_t n = 0;
+		for (int i = 0; i < ring.size(); i++)
+			n += blocks[ring[i]].used;
+		return n;
+	}
+
+protected:
+
+	// chunks as in the file: FrameHeader, payload, padding
+	struct Block
+	{
+		vector<unsigned char> data;
+		size_t used;
+		int num_frames;
+
+		// the ring and running dumps
+		int refs;
+	};
+
+	struct StreamData
+	{
+		StreamData() : frame_counter(0) {}
+
+		int frame_counter;
+		vector<unsigned char> encoded, packed;
+	};
+
+	class Dumper : public ofThread
+	{
+	public:
+
+		Dumper(ReplayBuffer *replay) : replay(replay) {}
+
+	protected:
+
+		ReplayBuffer *replay;
+
+		void threadedFunction()
+		{
+			replay->dump();
+		}
+	};
+
+	ofMutex mutex;
+
+	vector<recording::StreamHeader> stream_headers;
+	vector<StreamData> streams;
+	vector<Stream*> sources;
+
+	vector<Block> blocks;
+
+	// oldest first, the last one is current
+	deque<int> ring;
+	vector<int> free_blocks;
+	int current;
+
+	int num_frames;
+	unsigned int num_dropped;
+	uint64_t newest_timestamp;
+
+	bool dumping;
+
+	// dumper thread
+	RecordingWriter dump_file;
+	vector<int> dump_blocks;
+	size_t dump_current_used;
+	uint64_t dump_after;
+
+	Dumper dumper;
+
+	void resetBlocks()
+	{
+		ring.clear();
+		free_blocks.clear();
+
+		for (int i = blocks.size() - 1; i >= 0; i--)
+		{
+			blocks[i].used = 0;
+			blocks[i].num_frames = 0;
+			blocks[i].refs = 0;
+			free_blocks.push_back(i);
+		}
+
+		current = -1;
+		num_frames = 0;
+		newest_timestamp = 0;
+	}
+
+	// makes room for size bytes in the current block. call with the lock held
+	bool reserve(size_t size)
+	{
+		if (current >= 0 && blocks[current].used + size <= BLOCK_SIZE) return true;
+
+		// recycle the oldest blocks until one is free, except the one
+		// being filled
+		while (free_blocks.empty() && ring.size() > 1)
+		{
+			const int i = ring.front();
+			ring.pop_front();
+
+			num_frames -= blocks[i].num_frames;
+			release(i);
+		}
+
+		// all blocks are waiting for the dump
+		if (free_blocks.empty()) return false;
+
+		current = free_blocks.back();
+		free_blocks.pop_back();
+
+		Block &b = blocks[current];
+		b.used = 0;
+		b.num_frames = 0;
+		b.refs = 1;
+
+		ring.push_back(current);
+
+		return true;
+	}
+
+	// call with the lock held
+	void release(int i)
+	{
+		if (--blocks[i].refs == 0)
+			free_blocks.push_back(i);
+	}
+
+	void dump()
+	{
+		for (int k = 0; k < dump_blocks.size(); k++)
+		{
+			const int i = dump_blocks[k];
+			const Block &b = blocks[i];
+
+			// capture only appends after this point, the blocks before
+			// don't change while referenced
+			mutex.lock();
+			const size_t used = k + 1 == dump_blocks.size() ? dump_current_used : b.used;
+			mutex.unlock();
+
+			size_t offset = 0;
+			while (offset < used)
+			{
+				const recording::FrameHeader &h = *(const recording::FrameHeader*)&b.data[offset];
+
+				if (h.timestamp >= dump_after)
+					dump_file.write(h, &b.data[offset + sizeof(h)]);
+
+				offset += recording::align(sizeof(h) + h.payload_size);
+			}
+
+			mutex.lock();
+			release(i);
+			mutex.unlock();
+		}
+
+		dump_file.close();
+
+		ofLogVerbose("ofxNI2::ReplayBuffer") << "replay written, " << dump_file.getNumFrames() << " frames";
+
+		mutex.lock();
+		dumping = false;
+		mutex.unlock();
+	}
+
+	void onNewFrame(Stream &stream, const Frame &frame)
+	{
+		for (int i = 0; i < sources.size(); i++)
+		{
+			if (sources[i] != &stream) continue;
+
+			addFrame(i, frame.data, frame.width, frame.height, frame.timestamp, frame.frame_index, frame.stride);
+			return;
+		}
+	}
+};
@@ -0,0 +1,439 @@
+#pragma once
+
+#include "ofxNI2.h"
+#include "utils/RecordingReader.h"
+#include "utils/DepthPipeline.h"
+
+namespace ofxNI2
+{
+	class ReplayHarness;
+}
+
+// plays a FrameRecorder recording into Depth/Color/IrStreams through
+// Stream::processFrame(), the same setPixels() and FrameListener calls a
+// live frame goes through, and times the way of every frame:
+//
+//   read <sensor>      getting the frame out of the recording
+//   deliver <sensor>   setPixels() and the FrameListeners
+//   update             Device::update() and its updateDevice listeners
+//   app                from update() returning to the next call
+//   total              from the first delivery of a step to the next update()
+//   latency            FIXED_RATE, from the delivery to the update() seeing it
+//
+// plus anything timed with beginStage()/endStage() or addSample().
+//
+// LOCKSTEP delivers a step, the frames of every stream recorded together,
+// in each update(), so every frame is processed before the next comes and
+// the numbers compare between runs. FIXED_RATE delivers on a thread of its
+// own like a sensor does, and frames the app is too slow for are dropped.
+//
+//   harness.open("take.ni2r");
+//   harness.addStream(depth, openni::SENSOR_DEPTH);
+//   harness.start();
+//
+//   while (harness.update())
+//   {
+//       harness.beginStage("filter");
+//       ...
+//       harness.endStage();
+//   }
+//
+//   cout << harness.getReport();
+
+class ofxNI2::ReplayHarness
+{
+public:
+
+	enum Mode
+	{
+		LOCKSTEP,
+		FIXED_RATE
+	};
+
+	ReplayHarness() : mode(LOCKSTEP), fps(0), deliverer(this), num_steps(0), num_seen(0), num_dropped(0), step_time(0), is_done(false), seen_step_time(0), update_end(0) {}
+	~ReplayHarness() { close(); }
+
+	bool open(const string& path)
+	{
+		close();
+		return reader.open(path);
+	}
+
+	void close()
+	{
+		stop();
+
+		for (int i = 0; i < streams.size(); i++)
+			streams[i].stream->exit();
+
+		streams.clear();
+		reader.close();
+	}
+
+	// the streams are set up on this device, it isn't opened
+	Device& getDevice() { return device; }
+
+	const RecordingReader& getReader() const { return reader; }
+
+	// stream must not be set up. takes the first recorded stream of type
+	bool addStream(Stream &stream, openni::SensorType type)
+	{
+		assert(!deliverer.isThreadRunning());
+
+		const int index = reader.findStream(type);
+		if (index < 0)
+		{
+			ofLogError("ofxNI2::ReplayHarness") << "no " << getSensorName(type) << " stream in the recording";
+			return false;
+		}
+
+		const recording::StreamHeader &h = reader.getStreamHeader(index);
+
+		openni::VideoMode mode;
+		mode.setPixelFormat((openni::PixelFormat)h.pixel_format);
+		mode.setResolution(h.width, h.height);
+		mode.setFps(h.fps);
+
+		if (!stream.setupReplay(device, mode, reader.getIntrinsics(index))) return false;
+
+		StreamData s;
+		s.stream = &stream;
+		s.index = index;
+		s.name = getSensorName(type);
+		s.tolerance = 500000 / (h.fps > 0 ? h.fps : 30);
+		s.next_frame = 0;
+
+		streams.push_back(s);
+		return true;
+	}
+
+	// every update() delivers the next step
+	void setLockstep() { mode = LOCKSTEP; fps = 0; }
+
+	// steps at fps, or as recorded with 0
+	void setFixedRate(float fps = 0) { mode = FIXED_RATE; this->fps = std::max(fps, 0.f); }
+
+	Mode getMode() const { return mode; }
+
+	// from the first frame, statistics start over
+	void start()
+	{
+		stop();
+
+		for (int i = 0; i < streams.size(); i++)
+			streams[i].next_frame = 0;
+
+		ofScopedLock lock(mutex);
+
+		stages.clear();
+		stage_names.clear();
+
+		num_steps = num_seen = num_dropped = 0;
+		step_time = seen_step_time = 0;
+		update_end = 0;
+		is_done = false;
+
+		if (mode == FIXED_RATE)
+			deliverer.startThread(true, false);
+	}
+
+	void stop()
+	{
+		if (deliverer.isThreadRunning())
+			deliverer.waitForThread(true);
+	}
+
+	// call once per app frame like Device::update(). false when the
+	// recording is over
+	bool update()
+	{
+		const unsigned long long now = ofGetElapsedTimeMicros();
+
+		// the previous step went all the way through
+		if (update_end > 0)
+		{
+			addSample("app", (now - update_end) / 1000.);
+			addSample("total", (now - seen_step_time) / 1000.);
+			update_end = 0;
+		}
+
+		bool is_new = true;
+
+		if (mode == LOCKSTEP)
+		{
+			if (!deliverStep()) return false;
+
+			ofScopedLock lock(mutex);
+			num_seen = num_steps;
+			seen_step_time = step_time;
+		}
+		else
+		{
+			ofScopedLock lock(mutex);
+
+			if (num_seen == num_steps)
+			{
+				// nothing new, the app is faster than the frames
+				if (is_done) return false;
+				is_new = false;
+			}
+			else
+			{
+				num_dropped += num_steps - num_seen - 1;
+				num_seen = num_steps;
+				seen_step_time = step_time;
+
+				addSample("latency", (now - step_time) / 1000.);
+			}
+		}
+
+		const unsigned long long u = ofGetElapsedTimeMicros();
+		device.update();
+
+		if (is_new)
+		{
+			update_end = ofGetElapsedTimeMicros();
+			addSample("update", (update_end - u) / 1000.);
+		}
+
+		return true;
+	}
+
+	// times the app's own work between update() calls, main thread only
+	void beginStage(const string& name)
+	{
+		stage_name = name;
+		stage_start = ofGetElapsedTimeMicros();
+	}
+
+	void endStage()
+	{
+		addSample(stage_name, (ofGetElapsedTimeMicros() - stage_start) / 1000.);
+	}
+
+	// thread safe
+	void addSample(const string& name, float ms)
+	{
+		ofScopedLock lock(stats_mutex);
+
+		map<string, vector<float> >::iterator it = stages.find(name);
+
+		if (it == stages.end())
+		{
+			it = stages.insert(make_pair(name, vector<float>())).first;
+			stage_names.push_back(name);
+		}
+
+		it->second.push_back(ms);
+	}
+
+	// the timings of a new DepthPipeline result, as "pipeline <stage>"
+	void addSamples(const DepthPipeline &pipeline)
+	{
+		for (int i = 0; i < pipeline.getNumStages(); i++)
+			addSample("pipeline " + pipeline.getStageName(i), pipeline.getStageTime(i));
+	}
+
+	int getNumSteps() { ofScopedLock lock(mutex); return num_steps; }
+
+	// FIXED_RATE steps the app never saw
+	int getNumDropped() { ofScopedLock lock(mutex); return num_dropped; }
+
+	// one line per stage in milliseconds, in the order they first came up
+	string getReport()
+	{
+		ofScopedLock lock(stats_mutex);
+
+		stringstream ss;
+		ss << std::left << std::setw(24) << "stage" << std::right
+			<< std::setw(8) << "n" << std::setw(10) << "mean" << std::setw(10) << "p50"
+			<< std::setw(10) << "p95" << std::setw(10) << "p99" << std::setw(10) << "max" << endl;
+
+		for (int i = 0; i < stage_names.size(); i++)
+		{
+			vector<float> v = stages[stage_names[i]];
+			std::sort(v.begin(), v.end());
+
+			double sum = 0;
+			for (int j = 0; j < v.size(); j++) sum += v[j];
+
+			ss << std::left << std::setw(24) << stage_names[i] << std::right << std::setw(8) << v.size() << std::fixed << std::setprecision(3)
+				<< std::setw(10) << sum / v.size()
+				<< std::setw(10) << getPercentile(v, 0.5)
+				<< std::setw(10) << getPercentile(v, 0.95)
+				<< std::setw(10) << getPercentile(v, 0.99)
+				<< std::setw(10) << v.back() << endl;
+		}
+
+		return ss.str();
+	}
+
+protected:
+
+	struct StreamData
+	{
+		Stream *stream;
+		int index;
+		string name;
+
+		// frames of other streams this close belong to the same step
+		uint64_t tolerance;
+
+		int next_frame;
+	};
+
+	class Deliverer : public ofThread
+	{
+	public:
+
+		Deliverer(ReplayHarness *harness) : harness(harness) {}
+
+	protected:
+
+		ReplayHarness *harness;
+
+		void threadedFunction()
+		{
+			const unsigned long long start = ofGetElapsedTimeMicros();
+			int step = 0;
+			uint64_t first_timestamp = 0;
+
+			while (isThreadRunning())
+			{
+				uint64_t timestamp;
+				if (!harness->getNextTimestamp(timestamp)) break;
+
+				if (step == 0) first_timestamp = timestamp;
+
+				const unsigned long long due = start + (harness->fps > 0
+					? (unsigned long long)(step * 1000000. / harness->fps)
+					: timestamp - first_timestamp);
+
+				const unsigned long long now = ofGetElapsedTimeMicros();
+				if (due > now) ofSleepMillis((due - now) / 1000);
+
+				harness->deliverStep();
+				step++;
+			}
+
+			ofScopedLock lock(harness->mutex);
+			harness->is_done = true;
+		}
+	};
+
+	RecordingReader reader;
+	Device device;
+
+	vector<StreamData> streams;
+
+	Mode mode;
+	float fps;
+
+	Deliverer deliverer;
+
+	// guards the step counters between the threads
+	ofMutex mutex;
+	int num_steps, num_seen, num_dropped;
+	unsigned long long step_time;
+	bool is_done;
+
+	// main thread
+	unsigned long long seen_step_time, update_end;
+	string stage_name;
+	unsigned long long stage_start;
+
+	ofMutex stats_mutex;
+	map<string, vector<float> > stages;
+	vector<string> stage_names;
+
+	// earliest next frame of all streams
+	bool getNextTimestamp(uint64_t &timestamp)
+	{
+		bool found = false;
+
+		for (int i = 0; i < streams.size(); i++)
+		{
+			const StreamData &s = streams[i];
+			if (s.next_frame >= reader.getNumFrames(s.index)) continue;
+
+			const uint64_t t = reader.getTimestamp(s.index, s.next_frame);
+			if (!found || t < timestamp) timestamp = t;
+			found = true;
+		}
+
+		return found;
+	}
+
+	// the next frame of every stream recorded with the earliest one
+	bool deliverStep()
+	{
+		uint64_t timestamp;
+		if (!getNextTimestamp(timestamp)) return false;
+
+		const unsigned long long start = ofGetElapsedTimeMicros();
+
+		for (int i = 0; i < streams.size(); i++)
+		{
+			StreamData &s = streams[i];
+			if (s.next_frame >= reader.getNumFrames(s.index)
+				|| reader.getTimestamp(s.index, s.next_frame) > timestamp + s.tolerance) continue;
+
+			deliver(s, s.next_frame++);
+		}
+
+		ofScopedLock lock(mutex);
+		num_steps++;
+		step_time = start;
+
+		return true;
+	}
+
+	void deliver(StreamData &s, int frame)
+	{
+		unsigned long long t = ofGetElapsedTimeMicros();
+
+		const recording::StreamHeader &sh = reader.getStreamHeader(s.index);
+		const recording::FrameHeader &h = reader.getFrameHeader(s.index, frame);
+		const int bpp = recording::getBytesPerPixel((openni::PixelFormat)sh.pixel_format);
+
+		// decoded or a view of the file
+		const void *data = bpp == 2
+			? (const void*)reader.getShortPixels(s.index, frame).getPixels()
+			: (const void*)reader.getPixels(s.index, frame).getPixels();
+
+		Frame f;
+		f.data = data;
+		f.data_size = h.width * h.height * bpp;
+		f.width = h.width;
+		f.height = h.height;
+		f.stride = h.width * bpp;
+		f.timestamp = h.timestamp;
+		f.frame_index = h.frame_index;
+		f.video_mode.setPixelFormat((openni::PixelFormat)sh.pixel_format);
+		f.video_mode.setResolution(h.width, h.height);
+		f.video_mode.setFps(sh.fps);
+
+		addSample("read " + s.name, (ofGetElapsedTimeMicros() - t) / 1000.);
+		t = ofGetElapsedTimeMicros();
+
+		s.stream->processFrame(f);
+
+		addSample("deliver " + s.name, (ofGetElapsedTimeMicros() - t) / 1000.);
+	}
+
+	static float getPercentile(const vector<float> &sorted, float p)
+	{
+		return sorted[std::min((int)(p * sorted.size()), (int)sorted.size() - 1)];
+	}
+
+	static string getSensorName(openni::SensorType type)
+	{
+		switch (type)
+		{
+			case openni::SENSOR_DEPTH: return "depth";
+			case openni::SENSOR_COLOR: return "color";
+			case openni::SENSOR_IR: return "ir";
+			default: return "stream";
+		}
+	}
+};
@@ -0,0 +1,172 @@
+#pragma once
+
+#include "ofMain.h"
+
+namespace ofxNI2
+{
+	struct RvlCodec;
+}
+
+// lossless 16bit depth compression, "Fast Lossless Depth Image Compression"
+// (Andrew D. Wilson, ISS 2017). runs of zeros and runs of nonzero values
+// alternate, nonzero values are stored as zigzag deltas to the previous
+// nonzero value. everything is a variable length code of 3bit nibbles
+// packed into 32bit words, so it runs at memory speed and typical depth
+// frames shrink to 20-30%.
+
+struct ofxNI2::RvlCodec
+{
+	// upper bound of compress() output in bytes
+	static size_t getMaxCompressedSize(int num_pixels)
+	{
+		// worst case is 3 bytes per pixel plus one partial word
+		return ((size_t)num_pixels * 6 / 8 + 2) * 4;
+	}
+
+	// dst must hold getMaxCompressedSize(num_pixels) bytes. returns bytes written
+	static size_t compress(const unsigned short *src, int num_pixels, unsigned char *dst)
+	{
+		Writer w(dst);
+
+		const unsigned short *end = src + num_pixels;
+		int previous = 0;
+
+		while (src != end)
+		{
+			int zeros = 0;
+			while (src != end && *src == 0)
+			{
+				src++;
+				zeros++;
+			}
+			w.put(zeros);
+
+			int nonzeros = 0;
+			for (const unsigned short *p = src; p != end && *p != 0; p++)
+				nonzeros++;
+			w.put(nonzeros);
+
+			for (int i = 0; i < nonzeros; i++)
+			{
+				const int current = *src++;
+				const int delta = current - previous;
+				w.put((delta << 1) ^ (delta >> 31));
+				previous = current;
+			}
+		}
+
+		return w.finish() - dst;
+	}
+
+	// false if src is truncated or doesn't decode to exactly num_pixels
+	static bool decompress(const unsigned char *src, size_t src_size, unsigned short *dst, int num_pixels)
+	{
+		Reader r(src, src_size);
+
+		unsigned short *end = dst + num_pixels;
+		int previous = 0;
+
+		while (dst != end)
+		{
+			int zeros, nonzeros;
+
+			if (!r.get(zeros) || zeros > end - dst) return false;
+			memset(dst, 0, zeros * sizeof(unsigned short));
+			dst += zeros;
+
+			if (!r.get(nonzeros) || nonzeros > end - dst) return false;
+
+			for (int i = 0; i < nonzeros; i++)
+			{
+				int positive;
+				if (!r.get(positive)) return false;
+
+				const int delta = (positive >> 1) ^ -(positive & 1);
+				previous += delta;
+				*dst++ = previous;
+			}
+		}
+
+		return true;
+	}
+
+protected:
+
+	struct Writer
+	{
+		uint32_t *p;
+		uint32_t word;
+		int nibbles;
+
+		Writer(unsigned char *dst) : p((uint32_t*)dst), word(0), nibbles(0) {}
+
+		inline void put(unsigned int value)
+		{
+			do
+			{
+				unsigned int nibble = value & 7;
+				value >>= 3;
+				if (value) nibble |= 8;
+
+				word = (word << 4) | nibble;
+
+				if (++nibbles == 8)
+				{
+					*p++ = word;
+					nibbles = 0;
+					word = 0;
+				}
+			}
+			while (value);
+		}
+
+		unsigned char* finish()
+		{
+			if (nibbles)
+			{
+				*p++ = word << (4 * (8 - nibbles));
+				nibbles = 0;
+			}
+			return (unsigned char*)p;
+		}
+	};
+
+	struct Reader
+	{
+		const uint32_t *p, *end;
+		uint32_t word;
+		int nibbles;
+
+		Reader(const unsigned char *src, size_t size) : p((const uint32_t*)src), end((const uint32_t*)src + size / 4), word(0), nibbles(0) {}
+
+		inline bool get(int &value)
+		{
+			unsigned int v = 0;
+			int shift = 0;
+			unsigned int nibble;
+
+			do
+			{
+				if (nibbles == 0)
+				{
+					if (p == end) return false;
+					word = *p++;
+					nibbles = 8;
+				}
+
+				nibble = word >> 28;
+				word <<= 4;
+				nibbles--;
+
+				if (shift > 30) return false;
+
+				v |= (nibble & 7) << shift;
+				shift += 3;
+			}
+			while (nibble & 8);
+
+			value = v;
+			return true;
+		}
+	};
+};
@@ -0,0 +1,393 @@
+#pragma once
+
+#include "ofMain.h"
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define OFXNI2_SIMD_SSE2
+#include <emmintrin.h>
+#elif defined(__ARM_NEON__) || defined(__ARM_NEON)
+#define OFXNI2_SIMD_NEON
+#include <arm_neon.h>
+#endif
+
+// 8 lane vectors for per pixel kernels. unsigned short (depth) maps to
+// SSE2 or NEON registers when available, everything else falls back to
+// plain arrays the compiler is free to vectorize.
+
+namespace ofxNI2
+{
+namespace simd
+{
+
+template <typename T>
+struct Vec
+{
+	enum { WIDTH = 8 };
+
+	T v[WIDTH];
+
+	static inline Vec load(const T *p)
+	{
+		Vec o;
+		for (int i = 0; i < WIDTH; i++) o.v[i] = p[i];
+		return o;
+	}
+
+	inline void store(T *p) const
+	{
+		for (int i = 0; i < WIDTH; i++) p[i] = v[i];
+	}
+
+	static inline Vec set1(T x)
+	{
+		Vec o;
+		for (int i = 0; i < WIDTH; i++) o.v[i] = x;
+		return o;
+	}
+};
+
+template <typename T>
+inline T min(const T& a, const T& b) { return b < a ? b : a; }
+
+template <typename T>
+inline T max(const T& a, const T& b) { return a < b ? b : a; }
+
+template <typename T>
+inline Vec<T> min(const Vec<T>& a, const Vec<T>& b)
+{
+	Vec<T> o;
+	for (int i = 0; i < Vec<T>::WIDTH; i++) o.v[i] = b.v[i] < a.v[i] ? b.v[i] : a.v[i];
+	return o;
+}
+
+template <typename T>
+inline Vec<T> max(const Vec<T>& a, const Vec<T>& b)
+{
+	Vec<T> o;
+	for (int i = 0; i < Vec<T>::WIDTH; i++) o.v[i] = a.v[i] < b.v[i] ? b.v[i] : a.v[i];
+	return o;
+}
+
+// integer lanes only: wrapping add, bitwise and/or, eq gives all bits set
+
+template <typename T>
+inline Vec<T> add(const Vec<T>& a, const Vec<T>& b)
+{
+	Vec<T> o;
+	for (int i = 0; i < Vec<T>::WIDTH; i++) o.v[i] = a.v[i] + b.v[i];
+	return o;
+}
+
+template <typename T>
+inline Vec<T> bitAnd(const Vec<T>& a, const Vec<T>& b)
+{
+	Vec<T> o;
+	for (int i = 0; i < Vec<T>::WIDTH; i++) o.v[i] = a.v[i] & b.v[i];
+	return o;
+}
+
+template <typename T>
+inline Vec<T> bitOr(const Vec<T>& a, const Vec<T>& b)
+{
+	Vec<T> o;
+	for (int i = 0; i < Vec<T>::WIDTH; i++) o.v[i] = a.v[i] | b.v[i];
+	return o;
+}
+
+template <typename T>
+inline Vec<T> eq(const Vec<T>& a, const Vec<T>& b)
+{
+	Vec<T> o;
+	for (int i = 0; i < Vec<T>::WIDTH; i++) o.v[i] = -(T)(a.v[i] == b.v[i]);
+	return o;
+}
+
+// unsigned lanes only: saturating subtract, high half of the product
+
+template <typename T>
+inline Vec<T> subs(const Vec<T>& a, const Vec<T>& b)
+{
+	Vec<T> o;
+	for (int i = 0; i < Vec<T>::WIDTH; i++) o.v[i] = a.v[i] > b.v[i] ? a.v[i] - b.v[i] : 0;
+	return o;
+}
+
+template <typename T>
+inline Vec<T> mulhi(const Vec<T>& a, const Vec<T>& b)
+{
+	Vec<T> o;
+	for (int i = 0; i < Vec<T>::WIDTH; i++) o.v[i] = ((uint64_t)a.v[i] * b.v[i]) >> (sizeof(T) * 8);
+	return o;
+}
+
+// rounding up average, (a + b + 1) / 2 without overflow
+template <typename T>
+inline Vec<T> avg(const Vec<T>& a, const Vec<T>& b)
+{
+	Vec<T> o;
+	for (int i = 0; i < Vec<T>::WIDTH; i++) o.v[i] = ((uint64_t)a.v[i] + b.v[i] + 1) >> 1;
+	return o;
+}
+
+// splits the 2 * WIDTH values of a, b into even and odd positions
+template <typename T>
+inline void unzip(const Vec<T>& a, const Vec<T>& b, Vec<T>& even, Vec<T>& odd)
+{
+	const int H = Vec<T>::WIDTH / 2;
+
+	for (int i = 0; i < H; i++)
+	{
+		even.v[i] = a.v[i * 2];
+		odd.v[i] = a.v[i * 2 + 1];
+		even.v[i + H] = b.v[i * 2];
+		odd.v[i + H] = b.v[i * 2 + 1];
+	}
+}
+
+// one bit per lane of a mask (all bits set or clear), lane 0 is bit 0
+template <typename T>
+inline int movemask(const Vec<T>& m)
+{
+	int bits = 0;
+	for (int i = 0; i < Vec<T>::WIDTH; i++) bits |= (m.v[i] & 1) << i;
+	return bits;
+}
+
+#if defined(OFXNI2_SIMD_SSE2)
+
+template <>
+struct Vec<unsigned short>
+{
+	enum { WIDTH = 8 };
+
+	__m128i v;
+
+	static inline Vec load(const unsigned short *p)
+	{
+		Vec o;
+		o.v = _mm_loadu_si128((const __m128i*)p);
+		return o;
+	}
+
+	inline void store(unsigned short *p) const
+	{
+		_mm_storeu_si128((__m128i*)p, v);
+	}
+
+	static inline Vec set1(unsigned short x)
+	{
+		Vec o;
+		o.v = _mm_set1_epi16(x);
+		return o;
+	}
+};
+
+// SSE2 has no unsigned 16bit min/max, use saturating subtraction:
+// min(a, b) = a - (a -sat b), max(a, b) = b + (a -sat b)
+
+inline Vec<unsigned short> min(const Vec<unsigned short>& a, const Vec<unsigned short>& b)
+{
+	Vec<unsigned short> o;
+	o.v = _mm_sub_epi16(a.v, _mm_subs_epu16(a.v, b.v));
+	return o;
+}
+
+inline Vec<unsigned short> max(const Vec<unsigned short>& a, const Vec<unsigned short>& b)
+{
+	Vec<unsigned short> o;
+	o.v = _mm_add_epi16(b.v, _mm_subs_epu16(a.v, b.v));
+	return o;
+}
+
+inline Vec<unsigned short> add(const Vec<unsigned short>& a, const Vec<unsigned short>& b)
+{
+	Vec<unsigned short> o;
+	o.v = _mm_add_epi16(a.v, b.v);
+	return o;
+}
+
+inline Vec<unsigned short> bitAnd(const Vec<unsigned short>& a, const Vec<unsigned short>& b)
+{
+	Vec<unsigned short> o;
+	o.v = _mm_and_si128(a.v, b.v);
+	return o;
+}
+
+inline Vec<unsigned short> bitOr(const Vec<unsigned short>& a, const Vec<unsigned short>& b)
+{
+	Vec<unsigned short> o;
+	o.v = _mm_or_si128(a.v, b.v);
+	return o;
+}
+
+inline Vec<unsigned short> eq(const Vec<unsigned short>& a, const Vec<unsigned short>& b)
+{
+	Vec<unsigned short> o;
+	o.v = _mm_cmpeq_epi16(a.v, b.v);
+	return o;
+}
+
+inline Vec<unsigned short> subs(const Vec<unsigned short>& a, const Vec<unsigned short>& b)
+{
+	Vec<unsigned short> o;
+	o.v = _mm_subs_epu16(a.v, b.v);
+	return o;
+}
+
+inline Vec<unsigned short> mulhi(const Vec<unsigned short>& a, const Vec<unsigned short>& b)
+{
+	Vec<unsigned short> o;
+	o.v = _mm_mulhi_epu16(a.v, b.v);
+	return o;
+}
+
+inline Vec<unsigned short> avg(const Vec<unsigned short>& a, const Vec<unsigned short>& b)
+{
+	Vec<unsigned short> o;
+	o.v = _mm_avg_epu16(a.v, b.v);
+	return o;
+}
+
+// SSE2 only packs signed, so values are biased into int16 range and back
+inline void unzip(const Vec<unsigned short>& a, const Vec<unsigned short>& b, Vec<unsigned short>& even, Vec<unsigned short>& odd)
+{
+	const __m128i low = _mm_set1_epi32(0xFFFF);
+	const __m128i bias32 = _mm_set1_epi32(0x8000);
+	const __m128i bias16 = _mm_set1_epi16((short)0x8000);
+
+	const __m128i ea = _mm_sub_epi32(_mm_and_si128(a.v, low), bias32);
+	const __m128i eb = _mm_sub_epi32(_mm_and_si128(b.v, low), bias32);
+	const __m128i oa = _mm_sub_epi32(_mm_srli_epi32(a.v, 16), bias32);
+	const __m128i ob = _mm_sub_epi32(_mm_srli_epi32(b.v, 16), bias32);
+
+	even.v = _mm_xor_si128(_mm_packs_epi32(ea, eb), bias16);
+	odd.v = _mm_xor_si128(_mm_packs_epi32(oa, ob), bias16);
+}
+
+inline int movemask(const Vec<unsigned short>& m)
+{
+	return _mm_movemask_epi8(_mm_packs_epi16(m.v, m.v)) & 0xFF;
+}
+
+#elif defined(OFXNI2_SIMD_NEON)
+
+template <>
+struct Vec<unsigned short>
+{
+	enum { WIDTH = 8 };
+
+	uint16x8_t v;
+
+	static inline Vec load(const unsigned short *p)
+	{
+		Vec o;
+		o.v = vld1q_u16(p);
+		return o;
+	}
+
+	inline void store(unsigned short *p) const
+	{
+		vst1q_u16(p, v);
+	}
+
+	static inline Vec set1(unsigned short x)
+	{
+		Vec o;
+		o.v = vdupq_n_u16(x);
+		return o;
+	}
+};
+
+inline Vec<unsigned short> min(const Vec<unsigned short>& a, const Vec<unsigned short>& b)
+{
+	Vec<unsigned short> o;
+	o.v = vminq_u16(a.v, b.v);
+	return o;
+}
+
+inline Vec<unsigned short> max(const Vec<unsigned short>& a, const Vec<unsigned short>& b)
+{
+	Vec<unsigned short> o;
+	o.v = vmaxq_u16(a.v, b.v);
+	return o;
+}
+
+inline Vec<unsigned short> add(const Vec<unsigned short>& a, const Vec<unsigned short>& b)
+{
+	Vec<unsigned short> o;
+	o.v = vaddq_u16(a.v, b.v);
+	return o;
+}
+
+inline Vec<unsigned short> bitAnd(const Vec<unsigned short>& a, const Vec<unsigned short>& b)
+{
+	Vec<unsigned short> o;
+	o.v = vandq_u16(a.v, b.v);
+	return o;
+}
+
+inline Vec<unsigned short> bitOr(const Vec<unsigned short>& a, const Vec<unsigned short>& b)
+{
+	Vec<unsigned short> o;
+	o.v = vorrq_u16(a.v, b.v);
+	return o;
+}
+
+inline Vec<unsigned short> eq(const Vec<unsigned short>& a, const Vec<unsigned short>& b)
+{
+	Vec<unsigned short> o;
+	o.v = vceqq_u16(a.v, b.v);
+	return o;
+}
+
+inline Vec<unsigned short> subs(const Vec<unsigned short>& a, const Vec<unsigned short>& b)
+{
+	Vec<unsigned short> o;
+	o.v = vqsubq_u16(a.v, b.v);
+	return o;
+}
+
+inline Vec<unsigned short> mulhi(const Vec<unsigned short>& a, const Vec<unsigned short>& b)
+{
+	Vec<unsigned short> o;
+	const uint32x4_t lo = vmull_u16(vget_low_u16(a.v), vget_low_u16(b.v));
+	const uint32x4_t hi = vmull_u16(vget_high_u16(a.v), vget_high_u16(b.v));
+	o.v = vcombine_u16(vshrn_n_u32(lo, 16), vshrn_n_u32(hi, 16));
+	return o;
+}
+
+inline Vec<unsigned short> avg(const Vec<unsigned short>& a, const Vec<unsigned short>& b)
+{
+	Vec<unsigned short> o;
+	o.v = vrhaddq_u16(a.v, b.v);
+	return o;
+}
+
+inline void unzip(const Vec<unsigned short>& a, const Vec<unsigned short>& b, Vec<unsigned short>& even, Vec<unsigned short>& odd)
+{
+	const uint16x8x2_t r = vuzpq_u16(a.v, b.v);
+	even.v = r.val[0];
+	odd.v = r.val[1];
+}
+
+inline int movemask(const Vec<unsigned short>& m)
+{
+	static const uint16_t weights[8] = { 1, 2, 4, 8, 16, 32, 64, 128 };
+	const uint16x8_t w = vandq_u16(m.v, vld1q_u16(weights));
+	const uint64x2_t s = vpaddlq_u32(vpaddlq_u16(w));
+	return (int)(vgetq_lane_u64(s, 0) + vgetq_lane_u64(s, 1));
+}
+
+#endif
+
+// compare-exchange, the building block of sorting networks
+template <typename V>
+inline void sort2(V& a, V& b)
+{
+	const V lo = simd::min(a, b);
+	b = simd::max(a, b);
+	a = lo;
+}
+
+}
+}
@@ -0,0 +1,381 @@
+#pragma once
+
+#include "ofxNI2.h"
+#include "utils/AffineTransform.h"
+#include "utils/WorkerPool.h"
+
+namespace ofxNI2
+{
+	class SoftwareDepthReprojection;
+}
+
+// CPU counterpart of DepthReprojection for machines without a GPU.
+// depth (and optional registered color) is forward splatted into a
+// virtual camera with a z-buffer, then small holes are filled. without
+// color the color pixels stay black.
+//
+// projected pixels are binned by the band of target rows they land in, so
+// every band is splatted on its own thread from its own points only.
+//
+// the transform matrix is the pose of the virtual camera in the same
+// space as MeshGenerator's output. identity reproduces the input view.
+
+class ofxNI2::SoftwareDepthReprojection
+{
+public:
+
+	SoftwareDepthReprojection() : hole_fill_size(2), pool(NULL), src_depth(NULL), src_color(NULL), src_channels(0), num_blocks(0), num_bands(0) {}
+
+	void setup(DepthStream& depth_stream)
+	{
+		setup(depth_stream.getIntrinsics());
+	}
+
+	// target defaults to the source camera model
+	void setup(const Intrinsics& source, const Intrinsics& target = Intrinsics())
+	{
+		source_intrinsics = source;
+		target_intrinsics = target.isValid() ? target : source;
+
+		const int W = target_intrinsics.width;
+		const int H = target_intrinsics.height;
+
+		depth.allocate(W, H, 1);
+		depth.set(0);
+
+		color.allocate(W, H, 3);
+		color.set(0);
+
+		zbuffer.resize(W * H);
+		source_index.resize(W * H);
+	}
+
+	void update(const ofShortPixels& src, const ofPixels& src_col = ofPixels())
+	{
+		assert(src.getNumChannels() == 1);
+
+		if (!target_intrinsics.isValid()) return;
+
+		const int W = src.getWidth();
+		const int H = src.getHeight();
+
+		if (source_intrinsics.width != W || source_intrinsics.height != H)
+			source_intrinsics = source_intrinsics.getScaled(W, H);
+
+		src_depth = src.getPixels();
+		src_color = NULL;
+		src_channels = 0;
+
+		if (src_col.isAllocated()
+			&& src_col.getWidth() == W
+			&& src_col.getHeight() == H)
+		{
+			src_color = src_col.getPixels();
+			src_channels = src_col.getNumChannels();
+		}
+
+		view = AffineTransform(transform.getInverse());
+
+		projected.resize(W * H);
+		projected_depth.resize(W * H);
+
+		num_blocks = (H + BAND - 1) / BAND;
+		num_bands = (target_intrinsics.height + BAND - 1) / BAND;
+
+		bins.assign(num_blocks * num_bands, 0);
+		band_start.resize(num_bands + 1);
+
+		WorkerPool &p = pool ? *pool : WorkerPool::getShared();
+
+		Task task;
+		task.self = this;
+
+		task.phase = PROJECT;
+		p.run(task, 0, H, BAND);
+
+		// bins become write offsets, band by band and in source order
+		// within a band, so ties resolve the same way every run
+		unsigned int n = 0;
+
+		for (int t = 0; t < num_bands; t++)
+		{
+			band_start[t] = n;
+
+			for (int b = 0; b < num_blocks; b++)
+			{
+				const unsigned int c = bins[b * num_bands + t];
+				bins[b * num_bands + t] = n;
+				n += c;
+			}
+		}
+
+		band_start[num_bands] = n;
+		binned.resize(n);
+
+		task.phase = BIN;
+		p.run(task, 0, num_blocks, 1);
+
+		task.phase = SPLAT;
+		p.run(task, 0, num_bands, 1);
+
+		task.phase = FILL;
+		p.run(task, 0, target_intrinsics.height, 16);
+	}
+
+	const ofShortPixels& getDepthPixels() const { return depth; }
+	const ofPixels& getColorPixels() const { return color; }
+
+	const Intrinsics& getTargetIntrinsics() const { return target_intrinsics; }
+
+	void setTransformMatrix(const ofMatrix4x4& mat) { transform = mat; }
+	ofMatrix4x4 getTransformMatrix() const { return transform; }
+
+	// max hole width in pixels that gets filled, 0 disables
+	void setHoleFillSize(int v) { hole_fill_size = std::max(0, v); }
+	int getHoleFillSize() const { return hole_fill_size; }
+
+	// NULL uses WorkerPool::getShared()
+	void setWorkerPool(WorkerPool *p) { pool = p; }
+
+protected:
+
+	enum Phase
+	{
+		PROJECT,
+		BIN,
+		SPLAT,
+		FILL
+	};
+
+	class Task : public ParallelTask
+	{
+	public:
+
+		SoftwareDepthReprojection *self;
+		Phase phase;
+
+		void run(int begin, int end)
+		{
+			switch (phase)
+			{
+				case PROJECT: self->project(begin, end); break;
+				case BIN: self->bin(begin, end); break;
+				case SPLAT: self->splat(begin, end); break;
+				case FILL: self->fill(begin, end); break;
+			}
+		}
+	};
+
+	static const unsigned int INVALID = 0xFFFFFFFF;
+
+	// rows of a source block and of a target band
+	enum { BAND = 16 };
+
+	Intrinsics source_intrinsics, target_intrinsics;
+	ofMatrix4x4 transform;
+	AffineTransform view;
+
+	int hole_fill_size;
+	WorkerPool *pool;
+
+	const unsigned short *src_depth;
+	const unsigned char *src_color;
+	int src_channels;
+
+	// target pixel and depth of every source pixel
+	vector<unsigned int> projected;
+	vector<unsigned short> projected_depth;
+
+	// points per source block and target band, then where the block's
+	// points of the band go in binned
+	int num_blocks, num_bands;
+	vector<unsigned int> bins;
+	vector<unsigned int> band_start;
+
+	// source pixels ordered by target band
+	vector<unsigned int> binned;
+
+	// splat result before hole filling
+	vector<unsigned short> zbuffer;
+	vector<unsigned int> source_index;
+
+	ofShortPixels depth;
+	ofPixels color;
+
+	void project(int y0, int y1)
+	{
+		const Intrinsics &S = source_intrinsics;
+		const Intrinsics &T = target_intrinsics;
+
+		const int W = S.width;
+		const float inv_unit = 1. / T.depth_unit;
+
+		for (int y = y0; y < y1; y++)
+		{
+			for (int x = 0; x < W; x++)
+			{
+				const int idx = y * W + x;
+				projected[idx] = INVALID;
+
+				if (src_depth[idx] == 0) continue;
+
+				float X, Y, Z;
+				S.unproject(x, y, src_depth[idx], X, Y, Z);
+
+				// MeshGenerator space -> virtual camera space, which looks down -Z
+				float vx, vy, vz;
+				view.apply(X, Y, -Z, vx, vy, vz);
+
+				const float d = -vz;
+				if (d <= 0) continue;
+
+				const float inv_d = 1. / d;
+				const int u = floorf(vx * T.fx * inv_d + T.cx + 0.5f);
+				const int v = floorf(T.cy - vy * T.fy * inv_d + 0.5f);
+
+				if (u < 0 || u >= T.width || v < 0 || v >= T.height) continue;
+
+				const float raw = d * inv_unit;
+				if (raw >= 65535) continue;
+
+				projected[idx] = v * T.width + u;
+				projected_depth[idx] = std::max(1, (int)(raw + 0.5));
+
+				// blocks are never split between threads
+				bins[(y / BAND) * num_bands + v / BAND]++;
+			}
+		}
+	}
+
+	void bin(int b0, int b1)
+	{
+		const int W = source_intrinsics.width;
+		const int H = source_intrinsics.height;
+		const int TW = target_intrinsics.width;
+
+		for (int b = b0; b < b1; b++)
+		{
+			unsigned int *offsets = &bins[b * num_bands];
+
+			const int end = std::min((b + 1) * BAND, H) * W;
+
+			for (int idx = b * BAND * W; idx < end; idx++)
+			{
+				const unsigned int t = projected[idx];
+				if (t == INVALID) continue;
+
+				binned[offsets[(t / TW) / BAND]++] = idx;
+			}
+		}
+	}
+
+	void splat(int t0, int t1)
+	{
+		const int TW = target_intrinsics.width;
+		const unsigned int first = t0 * BAND * TW;
+		const unsigned int last = std::min(t1 * BAND, target_intrinsics.height) * TW;
+
+		std::fill(zbuffer.begin() + first, zbuffer.begin() + last, 0xFFFF);
+		std::fill(source_index.begin() + first, source_index.begin() + last, (unsigned int)INVALID);
+
+		for (int j = band_start[t0]; j < band_start[t1]; j++)
+		{
+			const unsigned int i = binned[j];
+			const unsigned int t = projected[i];
+
+			const unsigned short d = projected_depth[i];
+			if (d < zbuffer[t])
+			{
+				zbuffer[t] = d;
+				source_index[t] = i;
+			}
+		}
+	}
+
+	inline void copyColor(unsigned int src_idx, unsigned char *dst) const
+	{
+		if (src_idx == INVALID)
+		{
+			dst[0] = dst[1] = dst[2] = 0;
+		}
+		else if (src_channels >= 3)
+		{
+			const unsigned char *c = src_color + src_idx * src_channels;
+			dst[0] = c[0];
+			dst[1] = c[1];
+			dst[2] = c[2];
+		}
+		else
+		{
+			dst[0] = dst[1] = dst[2] = src_color[src_idx * src_channels];
+		}
+	}
+
+	// nearest splatted pixel from (x, y) in direction (dx, dy), -1 if none
+	inline int findValid(int x, int y, int dx, int dy) const
+	{
+		const int TW = target_intrinsics.width;
+		const int TH = target_intrinsics.height;
+
+		for (int i = 1; i <= hole_fill_size; i++)
+		{
+			const int xx = x + dx * i;
+			const int yy = y + dy * i;
+
+			if (xx < 0 || xx >= TW || yy < 0 || yy >= TH) return -1;
+
+			const int idx = yy * TW + xx;
+			if (source_index[idx] != INVALID) return idx;
+		}
+
+		return -1;
+	}
+
+	void fill(int y0, int y1)
+	{
+		const int TW = target_intrinsics.width;
+
+		unsigned short *dst_depth = depth.getPixels();
+		unsigned char *dst_color = color.getPixels();
+
+		for (int y = y0; y < y1; y++)
+		{
+			for (int x = 0; x < TW; x++)
+			{
+				const int idx = y * TW + x;
+
+				int from = source_index[idx] != INVALID ? idx : -1;
+
+				// a hole is filled only when it is bracketed on both sides, so
+				// silhouettes don't grow. the farther side wins, since holes
+				// next to edges are usually disoccluded background
+				if (from < 0 && hole_fill_size > 0)
+				{
+					const int l = findValid(x, y, -1, 0);
+					const int r = l >= 0 ? findValid(x, y, 1, 0) : -1;
+					const int u = findValid(x, y, 0, -1);
+					const int d = u >= 0 ? findValid(x, y, 0, 1) : -1;
+
+					if (l >= 0 && r >= 0)
+						from = zbuffer[l] > zbuffer[r] ? l : r;
+
+					if (u >= 0 && d >= 0)
+					{
+						const int v = zbuffer[u] > zbuffer[d] ? u : d;
+						if (from < 0 || zbuffer[v] > zbuffer[from]) from = v;
+					}
+				}
+
+				if (from < 0)
+				{
+					dst_depth[idx] = 0;
+					dst_color[idx * 3 + 0] = dst_color[idx * 3 + 1] = dst_color[idx * 3 + 2] = 0;
+					continue;
+				}
+
+				dst_depth[idx] = zbuffer[from];
+				copyColor(src_color ? source_index[from] : INVALID, dst_color + idx * 3);
+			}
+		}
+	}
+};
@@ -0,0 +1,410 @@
+#pragma once
+
+#include "ofMain.h"
+#include "utils/WorkerPool.h"
+
+namespace ofxNI2
+{
+	class SpatialDepthFilter;
+}
+
+// edge preserving smoothing for depth frames where 0 means no reading.
+//
+// BILATERAL is a separable joint bilateral filter, DOMAIN_TRANSFORM is the
+// recursive filter from Gastal and Oliveira's "Domain Transform for
+// Edge-Aware Image and Video Processing", which costs the same for any
+// spatial sigma. both take their edges from a guide: the depth itself, or
+// a registered color image of the same size.
+//
+// range weights come from lookup tables indexed by the guide difference,
+// in raw depth units or in 8bit color levels (mean over the channels).
+// pixels without depth neither contribute nor get filled.
+
+class ofxNI2::SpatialDepthFilter
+{
+public:
+
+	enum Mode
+	{
+		BILATERAL,
+		DOMAIN_TRANSFORM
+	};
+
+	SpatialDepthFilter() : mode(DOMAIN_TRANSFORM), spatial_sigma(3), range_sigma(30), num_iterations(3), pool(NULL), width(0), height(0), depth_pix(NULL), guide_pix(NULL), guide_channels(0), radius(0), lut_dirty(true) {}
+
+	const ofShortPixels& update(const ofShortPixels& depth)
+	{
+		return update(depth, ofPixels());
+	}
+
+	// guide must be the same size as depth, otherwise depth is its own guide
+	const ofShortPixels& update(const ofShortPixels& depth, const ofPixels& guide)
+	{
+		assert(depth.getNumChannels() == 1);
+
+		width = depth.getWidth();
+		height = depth.getHeight();
+		depth_pix = depth.getPixels();
+
+		guide_pix = NULL;
+		guide_channels = 0;
+
+		if (guide.isAllocated()
+			&& guide.getWidth() == width
+			&& guide.getHeight() == height)
+		{
+			guide_pix = guide.getPixels();
+			guide_channels = guide.getNumChannels();
+		}
+
+		if (!result.isAllocated()
+			|| result.getWidth() != width
+			|| result.getHeight() != height)
+		{
+			result.allocate(width, height, 1);
+		}
+
+		value.resize(width * height);
+
+		if (lut_dirty) buildTables();
+
+		WorkerPool &p = pool ? *pool : WorkerPool::getShared();
+
+		Task task;
+		task.self = this;
+
+		if (mode == BILATERAL)
+		{
+			task.phase = BILATERAL_H;
+			p.run(task, 0, height, ROWS_PER_TASK);
+
+			task.phase = BILATERAL_V;
+			p.run(task, 0, width, COLUMNS_PER_TASK);
+		}
+		else
+		{
+			diff_h.resize(width * height);
+			diff_v.resize(width * height);
+
+			task.phase = PREPARE;
+			p.run(task, 0, height, ROWS_PER_TASK);
+
+			for (int i = 0; i < num_iterations; i++)
+			{
+				weight = &iteration_lut[i * LUT_SIZE];
+
+				task.phase = RECURSIVE_H;
+				p.run(task, 0, height, ROWS_PER_TASK);
+
+				task.phase = RECURSIVE_V;
+				p.run(task, 0, width, COLUMNS_PER_TASK);
+			}
+
+			task.phase = STORE;
+			p.run(task, 0, height, ROWS_PER_TASK);
+		}
+
+		return result;
+	}
+
+	const ofShortPixels& getPixels() const { return result; }
+
+	void setMode(Mode m) { mode = m; }
+	Mode getMode() const { return mode; }
+
+	// spatial extent in pixels
+	void setSpatialSigma(float v) { spatial_sigma = ofClamp(v, 0.5, 64); lut_dirty = true; }
+	float getSpatialSigma() const { return spatial_sigma; }
+
+	// edge strength in raw depth units, or color levels with a color guide
+	void setRangeSigma(float v) { range_sigma = std::max(v, 0.01f); lut_dirty = true; }
+	float getRangeSigma() const { return range_sigma; }
+
+	// DOMAIN_TRANSFORM only, 3 is usually enough
+	void setNumIterations(int v) { num_iterations = ofClamp(v, 1, 8); lut_dirty = true; }
+	int getNumIterations() const { return num_iterations; }
+
+	// NULL uses WorkerPool::getShared()
+	void setWorkerPool(WorkerPool *p) { pool = p; }
+
+protected:
+
+	enum Phase
+	{
+		BILATERAL_H,
+		BILATERAL_V,
+		PREPARE,
+		RECURSIVE_H,
+		RECURSIVE_V,
+		STORE
+	};
+
+	class Task : public ParallelTask
+	{
+	public:
+
+		SpatialDepthFilter *self;
+		Phase phase;
+
+		void run(int begin, int end)
+		{
+			switch (phase)
+			{
+				case BILATERAL_H: self->bilateralH(begin, end); break;
+				case BILATERAL_V: self->bilateralV(begin, end); break;
+				case PREPARE: self->prepare(begin, end); break;
+				case RECURSIVE_H: self->recursiveH(begin, end); break;
+				case RECURSIVE_V: self->recursiveV(begin, end); break;
+				case STORE: self->store(begin, end); break;
+			}
+		}
+	};
+
+	enum
+	{
+		ROWS_PER_TASK = 16,
+		COLUMNS_PER_TASK = 64,
+
+		// guide differences are clamped to LUT_SIZE - 2, the last entry
+		// marks a pair with a missing depth and always weighs 0
+		LUT_SIZE = 4096,
+		NO_EDGE = LUT_SIZE - 1
+	};
+
+	Mode mode;
+	float spatial_sigma, range_sigma;
+	int num_iterations;
+
+	WorkerPool *pool;
+
+	int width, height;
+	const unsigned short *depth_pix;
+	const unsigned char *guide_pix;
+	int guide_channels;
+
+	// bilateral
+	int radius;
+	vector<float> spatial_lut;
+	vector<float> range_lut;
+
+	// domain transform
+	vector<float> iteration_lut;
+	const float *weight;
+	vector<unsigned short> diff_h, diff_v;
+
+	bool lut_dirty;
+
+	vector<float> value;
+	ofShortPixels result;
+
+	void buildTables()
+	{
+		lut_dirty = false;
+
+		radius = ceilf(spatial_sigma * 2);
+
+		spatial_lut.resize(radius + 1);
+		for (int i = 0; i <= radius; i++)
+			spatial_lut[i] = expf(-(i * i) / (2 * spatial_sigma * spatial_sigma));
+
+		range_lut.resize(LUT_SIZE);
+		for (int i = 0; i < NO_EDGE; i++)
+			range_lut[i] = expf(-(i * i) / (2 * range_sigma * range_sigma));
+		range_lut[NO_EDGE] = 0;
+
+		// per iteration feedback a^(1 + sigma_s / sigma_r * |dI|), with the
+		// spatial sigma shrinking each iteration (eq. 14 of the paper)
+		iteration_lut.resize(num_iterations * LUT_SIZE);
+
+		const float ratio = spatial_sigma / range_sigma;
+
+		for (int i = 0; i < num_iterations; i++)
+		{
+			const float sigma_h = spatial_sigma * sqrtf(3.f)
+				* powf(2.f, num_iterations - i - 1)
+				/ sqrtf(powf(4.f, num_iterations) - 1);
+			const float a = expf(-sqrtf(2.f) / sigma_h);
+
+			float *lut = &iteration_lut[i * LUT_SIZE];
+			for (int d = 0; d < NO_EDGE; d++)
+				lut[d] = powf(a, 1 + ratio * d);
+			lut[NO_EDGE] = 0;
+		}
+	}
+
+	// guide difference between two pixels with depth
+	inline int guideDiff(int a, int b) const
+	{
+		int d;
+
+		if (guide_pix)
+		{
+			const unsigned char *ga = guide_pix + a * guide_channels;
+			const unsigned char *gb = guide_pix + b * guide_channels;
+
+			d = 0;
+			for (int c = 0; c < guide_channels; c++)
+				d += abs(ga[c] - gb[c]);
+			d /= guide_channels;
+		}
+		else
+		{
+			d = abs(depth_pix[a] - depth_pix[b]);
+		}
+
+		return std::min(d, (int)NO_EDGE - 1);
+	}
+
+	void bilateralH(int y0, int y1)
+	{
+		const int r = radius;
+
+		for (int y = y0; y < y1; y++)
+		{
+			const int row = y * width;
+
+			for (int x = 0; x < width; x++)
+			{
+				const int idx = row + x;
+
+				if (depth_pix[idx] == 0)
+				{
+					value[idx] = 0;
+					continue;
+				}
+
+				const int k0 = std::max(-r, -x);
+				const int k1 = std::min(r, width - 1 - x);
+
+				float sum = 0, wsum = 0;
+
+				for (int k = k0; k <= k1; k++)
+				{
+					const unsigned short d = depth_pix[idx + k];
+					if (d == 0) continue;
+
+					const float w = spatial_lut[abs(k)] * range_lut[guideDiff(idx, idx + k)];
+					sum += w * d;
+					wsum += w;
+				}
+
+				value[idx] = sum / wsum;
+			}
+		}
+	}
+
+	// second pass reads the horizontal result, with edges still taken
+	// from the guide
+	void bilateralV(int x0, int x1)
+	{
+		const int r = radius;
+		unsigned short *dst = result.getPixels();
+
+		for (int y = 0; y < height; y++)
+		{
+			const int k0 = std::max(-r, -y);
+			const int k1 = std::min(r, height - 1 - y);
+
+			for (int x = x0; x < x1; x++)
+			{
+				const int idx = y * width + x;
+
+				if (depth_pix[idx] == 0)
+				{
+					dst[idx] = 0;
+					continue;
+				}
+
+				float sum = 0, wsum = 0;
+
+				for (int k = k0; k <= k1; k++)
+				{
+					const int n = idx + k * width;
+					if (depth_pix[n] == 0) continue;
+
+					const float w = spatial_lut[abs(k)] * range_lut[guideDiff(idx, n)];
+					sum += w * value[n];
+					wsum += w;
+				}
+
+				dst[idx] = sum / wsum + 0.5f;
+			}
+		}
+	}
+
+	// diff_h[i] is the edge between i - 1 and i, diff_v[i] between i - width
+	// and i. the guide is fixed, so this is done once for all iterations
+	void prepare(int y0, int y1)
+	{
+		for (int y = y0; y < y1; y++)
+		{
+			const int row = y * width;
+
+			for (int x = 0; x < width; x++)
+			{
+				const int idx = row + x;
+				const bool valid = depth_pix[idx] != 0;
+
+				value[idx] = depth_pix[idx];
+
+				diff_h[idx] = (x > 0 && valid && depth_pix[idx - 1])
+					? guideDiff(idx - 1, idx) : NO_EDGE;
+
+				diff_v[idx] = (y > 0 && valid && depth_pix[idx - width])
+					? guideDiff(idx - width, idx) : NO_EDGE;
+			}
+		}
+	}
+
+	void recursiveH(int y0, int y1)
+	{
+		const float *lut = weight;
+
+		for (int y = y0; y < y1; y++)
+		{
+			float *v = &value[y * width];
+			const unsigned short *e = &diff_h[y * width];
+
+			for (int x = 1; x < width; x++)
+				v[x] += lut[e[x]] * (v[x - 1] - v[x]);
+
+			for (int x = width - 2; x >= 0; x--)
+				v[x] += lut[e[x + 1]] * (v[x + 1] - v[x]);
+		}
+	}
+
+	// rows are walked in order and each row is a straight loop over the
+	// column band, so the inner loop stays contiguous
+	void recursiveV(int x0, int x1)
+	{
+		const float *lut = weight;
+
+		for (int y = 1; y < height; y++)
+		{
+			float *v = &value[y * width];
+			const float *prev = v - width;
+			const unsigned short *e = &diff_v[y * width];
+
+			for (int x = x0; x < x1; x++)
+				v[x] += lut[e[x]] * (prev[x] - v[x]);
+		}
+
+		for (int y = height - 2; y >= 0; y--)
+		{
+			float *v = &value[y * width];
+			const float *next = v + width;
+			const unsigned short *e = &diff_v[(y + 1) * width];
+
+			for (int x = x0; x < x1; x++)
+				v[x] += lut[e[x]] * (next[x] - v[x]);
+		}
+	}
+
+	void store(int y0, int y1)
+	{
+		unsigned short *dst = result.getPixels();
+
+		for (int i = y0 * width; i < y1 * width; i++)
+			dst[i] = depth_pix[i] ? (unsigned short)(value[i] + 0.5f) : 0;
+	}
+};
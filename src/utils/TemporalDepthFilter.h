@@ -0,0 +1,191 @@
+#pragma once
+
+#include "ofMain.h"
+#include "utils/TimedomainMedianFilter.h"
+
+namespace ofxNI2
+{
+	template <typename T, int NUM_FRAME>
+	class TemporalDepthFilter;
+}
+
+// temporal filter for integer depth where 0 means no reading.
+//
+// the median is taken over the valid samples of the last NUM_FRAME frames
+// only, and needs at least getMinValidSamples() of them. optionally the
+// last valid output of a pixel is held for up to getMaxHoldAge() frames
+// while it has no reading. with NUM_FRAME = 1 this is a plain
+// hold-last-valid filter.
+//
+// history is kept in the same TileHistory as TimedomainMedianFilter. a
+// tile is fully sorted with a vector network, which moves the invalid
+// samples to the front, and the median index is picked per lane.
+
+template <typename T, int NUM_FRAME = 5>
+class ofxNI2::TemporalDepthFilter
+{
+public:
+
+	TemporalDepthFilter() : min_valid_samples(1), max_hold_age(0), use_threads(false), pool(NULL) {}
+
+	void setup(int w, int h)
+	{
+		history.setup(w * h);
+
+		last_valid.clear();
+		last_valid.resize(w * h, 0);
+
+		age.clear();
+		age.resize(w * h, 0);
+
+		result.allocate(w, h, OF_IMAGE_GRAYSCALE);
+		result.set(0);
+	}
+
+	const ofPixels_<T>& update(const ofPixels_<T> &pix)
+	{
+		assert(pix.getNumChannels() == 1);
+		assert(pix.getWidth() * pix.getHeight() == history.getNumPixels());
+
+		if (use_threads)
+		{
+			Task task;
+			task.self = this;
+			task.src = pix.getPixels();
+			task.dst = result.getPixels();
+
+			WorkerPool &p = pool ? *pool : WorkerPool::getShared();
+			p.run(task, 0, history.getNumTiles(), TILES_PER_TASK);
+		}
+		else
+		{
+			filter(pix.getPixels(), result.getPixels(), 0, history.getNumTiles());
+		}
+
+		history.advance();
+
+		return result;
+	}
+
+	const ofPixels_<T>& get() const { return result; }
+	ofPixels_<T>& get() { return result; }
+
+	void setMinValidSamples(int v) { min_valid_samples = ofClamp(v, 1, NUM_FRAME); }
+	int getMinValidSamples() const { return min_valid_samples; }
+
+	// 0 disables holding
+	void setMaxHoldAge(int frames) { max_hold_age = ofClamp(frames, 0, 65535); }
+	int getMaxHoldAge() const { return max_hold_age; }
+
+	// same as TimedomainMedianFilter::setUseThreads()
+	void setUseThreads(bool v = true, WorkerPool *p = NULL) { use_threads = v; pool = p; }
+	bool getUseThreads() const { return use_threads; }
+
+protected:
+
+	typedef TileHistory<T, NUM_FRAME> History;
+	typedef simd::Vec<T> V;
+
+	enum { LANES = History::LANES };
+	enum { TILES_PER_TASK = 512 };
+
+	class Task : public ParallelTask
+	{
+	public:
+
+		TemporalDepthFilter *self;
+		const T *src;
+		T *dst;
+
+		void run(int begin, int end) { self->filter(src, dst, begin, end); }
+	};
+
+	int min_valid_samples;
+	int max_hold_age;
+
+	bool use_threads;
+	WorkerPool *pool;
+
+	History history;
+
+	vector<T> last_valid;
+	vector<unsigned short> age;
+
+	ofPixels_<T> result;
+
+	void filter(const T *src, T *dst, int tile_begin, int tile_end)
+	{
+		const V zero = V::set1(0);
+		const V one = V::set1(1);
+
+		V v[NUM_FRAME];
+		T out[LANES];
+
+		for (int t = tile_begin; t < tile_end; t++)
+		{
+			const T *tile = history.push(t, src);
+
+			const int offset = t * LANES;
+			const int n = history.getTileSize(t);
+
+			V num_invalid = zero;
+
+			for (int i = 0; i < NUM_FRAME; i++)
+			{
+				v[i] = V::load(tile + i * LANES);
+				num_invalid = simd::add(num_invalid, simd::bitAnd(simd::eq(v[i], zero), one));
+			}
+
+			Sort<NUM_FRAME>::network(v);
+
+			// invalid samples are sorted to the front, so the median of the
+			// valid ones sits at (NUM_FRAME - 1 + num_invalid) / 2
+			const V pos = simd::add(num_invalid, V::set1(NUM_FRAME - 1));
+
+			V median = zero;
+
+			for (int i = 0; i < NUM_FRAME; i++)
+			{
+				const V sel = simd::bitOr(simd::eq(pos, V::set1(i * 2)), simd::eq(pos, V::set1(i * 2 + 1)));
+				median = simd::bitOr(median, simd::bitAnd(sel, v[i]));
+			}
+
+			// enough valid samples: num_invalid <= NUM_FRAME - min_valid_samples
+			V enough = zero;
+
+			for (int i = 0; i <= NUM_FRAME - min_valid_samples; i++)
+				enough = simd::bitOr(enough, simd::eq(num_invalid, V::set1(i)));
+
+			simd::bitAnd(median, enough).store(out);
+
+			if (max_hold_age > 0)
+				hold(out, offset, n);
+
+			memcpy(dst + offset, out, n * sizeof(T));
+		}
+	}
+
+	inline void hold(T *out, int offset, int n)
+	{
+		T *last = &last_valid[offset];
+		unsigned short *a = &age[offset];
+
+		for (int l = 0; l < n; l++)
+		{
+			if (out[l] != 0)
+			{
+				last[l] = out[l];
+				a[l] = 0;
+			}
+			else if (a[l] < max_hold_age)
+			{
+				out[l] = last[l];
+				a[l]++;
+			}
+			else
+			{
+				last[l] = 0;
+			}
+		}
+	}
+};
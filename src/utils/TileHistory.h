@@ -0,0 +1,67 @@
+#pragma once
+
+#include "ofMain.h"
+#include "utils/Simd.h"
+
+namespace ofxNI2
+{
+	template <typename T, int NUM_FRAME>
+	class TileHistory;
+}
+
+// ring of the last NUM_FRAME frames, kept pixel-major in tiles of
+// simd::Vec<T>::WIDTH pixels with all frames of a tile next to each other.
+// a tile is one or two cache lines and loads as NUM_FRAME vectors.
+
+template <typename T, int NUM_FRAME>
+class ofxNI2::TileHistory
+{
+public:
+
+	enum { LANES = simd::Vec<T>::WIDTH };
+
+	TileHistory() : current_frame_index(0), num_pixels(0), num_tiles(0) {}
+
+	void setup(int num_pixels)
+	{
+		this->num_pixels = num_pixels;
+		num_tiles = (num_pixels + LANES - 1) / LANES;
+		current_frame_index = 0;
+
+		history.clear();
+		history.resize(num_tiles * NUM_FRAME * LANES, 0);
+	}
+
+	inline int getNumPixels() const { return num_pixels; }
+	inline int getNumTiles() const { return num_tiles; }
+
+	// valid pixels of a tile, less than LANES only for the last one
+	inline int getTileSize(int t) const { return std::min((int)LANES, num_pixels - t * LANES); }
+
+	inline T* getTile(int t) { return &history[t * NUM_FRAME * LANES]; }
+
+	// write the tile's pixels of the current frame into its slot. unused
+	// lanes of the last tile stay zero
+	inline T* push(int t, const T *frame)
+	{
+		T *tile = getTile(t);
+		memcpy(tile + current_frame_index * LANES, frame + t * LANES, getTileSize(t) * sizeof(T));
+		return tile;
+	}
+
+	// call once all tiles of a frame are pushed
+	void advance()
+	{
+		current_frame_index++;
+		current_frame_index %= NUM_FRAME;
+	}
+
+	inline int getCurrentFrameIndex() const { return current_frame_index; }
+
+protected:
+
+	int current_frame_index;
+	int num_pixels, num_tiles;
+
+	vector<T> history;
+};
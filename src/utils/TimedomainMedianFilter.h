@@ -1,6 +1,9 @@
 #pragma once
 
 #include "ofMain.h"
+#include "utils/Simd.h"
+#include "utils/TileHistory.h"
+#include "utils/WorkerPool.h"
 
 namespace ofxNI2
 {
@@ -10,6 +13,8 @@ namespace ofxNI2
 template <typename T, int N>
 struct Median
 {
+	enum { HAS_NETWORK = 0 };
+
 	inline static T torben(T *m, int n)
 	{
 		int i, less, greater, equal;
@@ -57,12 +62,18 @@ struct Median
 	}
 };
 
-#define PIX_SORT(a, b) { if ((a) > (b)) std::swap((a), (b)); }
+// the networks are written for any type with simd::min / simd::max, so
+// they run on single pixels or on simd::Vec of 8 pixels alike
+
+#define PIX_SORT(a, b) simd::sort2((a), (b))
 
 template <typename T>
 struct Median<T, 3>
 {
-	inline static T opt_med3(T * p)
+	enum { HAS_NETWORK = 1 };
+
+	template <typename V>
+	inline static V network(V * p)
 	{
 		PIX_SORT(p[0], p[1]);
 		PIX_SORT(p[1], p[2]);
@@ -70,6 +81,11 @@ struct Median<T, 3>
 		return(p[1]);
 	}
 
+	inline static T opt_med3(T * p)
+	{
+		return network(p);
+	}
+
 	inline static T get(T *m)
 	{
 		return opt_med3(m);
@@ -79,7 +95,10 @@ struct Median<T, 3>
 template <typename T>
 struct Median<T, 5>
 {
-	inline static T opt_med5(T * p)
+	enum { HAS_NETWORK = 1 };
+
+	template <typename V>
+	inline static V network(V * p)
 	{
 		PIX_SORT(p[0], p[1]);
 		PIX_SORT(p[3], p[4]);
@@ -91,6 +110,11 @@ struct Median<T, 5>
 		return(p[2]);
 	}
 
+	inline static T opt_med5(T * p)
+	{
+		return network(p);
+	}
+
 	inline static T get(T *m)
 	{
 		return opt_med5(m);
@@ -100,7 +124,10 @@ struct Median<T, 5>
 template <typename T>
 struct Median<T, 7>
 {
-	inline static T opt_med7(T * p)
+	enum { HAS_NETWORK = 1 };
+
+	template <typename V>
+	inline static V network(V * p)
 	{
 		PIX_SORT(p[0], p[5]);
 		PIX_SORT(p[0], p[3]);
@@ -118,58 +145,155 @@ struct Median<T, 7>
 		return (p[3]);
 	}
 
+	inline static T opt_med7(T * p)
+	{
+		return network(p);
+	}
+
 	inline static T get(T *m)
 	{
 		return opt_med7(m);
 	}
 };
 
+template <typename T>
+struct Median<T, 9>
+{
+	enum { HAS_NETWORK = 1 };
+
+	template <typename V>
+	inline static V network(V * p)
+	{
+		PIX_SORT(p[1], p[2]);
+		PIX_SORT(p[4], p[5]);
+		PIX_SORT(p[7], p[8]);
+		PIX_SORT(p[0], p[1]);
+		PIX_SORT(p[3], p[4]);
+		PIX_SORT(p[6], p[7]);
+		PIX_SORT(p[1], p[2]);
+		PIX_SORT(p[4], p[5]);
+		PIX_SORT(p[7], p[8]);
+		PIX_SORT(p[0], p[3]);
+		PIX_SORT(p[5], p[8]);
+		PIX_SORT(p[4], p[7]);
+		PIX_SORT(p[3], p[6]);
+		PIX_SORT(p[1], p[4]);
+		PIX_SORT(p[2], p[5]);
+		PIX_SORT(p[4], p[7]);
+		PIX_SORT(p[4], p[2]);
+		PIX_SORT(p[6], p[4]);
+		PIX_SORT(p[4], p[2]);
+		return (p[4]);
+	}
+
+	inline static T opt_med9(T * p)
+	{
+		return network(p);
+	}
+
+	inline static T get(T *m)
+	{
+		return opt_med9(m);
+	}
+};
+
+// full sort of N values, odd-even transposition network. not optimal in
+// the number of compare-exchanges, but valid for any N and branch free
+
+template <int N>
+struct Sort
+{
+	template <typename V>
+	inline static void network(V * p)
+	{
+		for (int round = 0; round < N; round++)
+		{
+			for (int i = round & 1; i + 1 < N; i += 2)
+				PIX_SORT(p[i], p[i + 1]);
+		}
+	}
+};
+
 #undef PIX_SORT
 
+// median of one tile: NUM_FRAME rows of simd::Vec<T>::WIDTH pixels
+
+template <typename T, int N, bool HAS_NETWORK = Median<T, N>::HAS_NETWORK>
+struct TileMedian
+{
+	enum { LANES = simd::Vec<T>::WIDTH };
+
+	inline static void get(const T *tile, T *dst)
+	{
+		T arr[N];
+
+		for (int l = 0; l < LANES; l++)
+		{
+			for (int i = 0; i < N; i++)
+				arr[i] = tile[i * LANES + l];
+
+			dst[l] = Median<T, N>::get(arr);
+		}
+	}
+};
+
+template <typename T, int N>
+struct TileMedian<T, N, true>
+{
+	typedef simd::Vec<T> V;
+
+	inline static void get(const T *tile, T *dst)
+	{
+		V v[N];
+
+		for (int i = 0; i < N; i++)
+			v[i] = V::load(tile + i * V::WIDTH);
+
+		Median<T, N>::network(v).store(dst);
+	}
+};
+
+// history is kept in a TileHistory and the median network runs on all
+// pixels of a tile at once. window sizes without a network (other than
+// 3, 5, 7 and 9) use Torben's method per pixel, which is much slower, so
+// large windows want setUseThreads().
+
 template <typename T, int NUM_FRAME = 5>
 class TimedomainMedianFilter
 {
 public:
 
-	TimedomainMedianFilter() : current_frame_index(0) {}
+	TimedomainMedianFilter() : use_threads(false), pool(NULL) {}
 
 	void setup(int w, int h)
 	{
-		pixels.resize(w * h * NUM_FRAME, 0);
+		history.setup(w * h);
+
 		result.allocate(w, h, OF_IMAGE_GRAYSCALE);
 		result.set(0);
 	}
 
-	const ofPixels_<T>& update(ofPixels_<T> &pix)
+	const ofPixels_<T>& update(const ofPixels_<T> &pix)
 	{
 		assert(pix.getNumChannels() == 1);
-		
-		const int N = pix.getWidth() * pix.getHeight();
-
-		T *pixels_ptr = &pixels[0];
-
-		memcpy(pixels_ptr + current_frame_index * N, pix.getPixels(), N);
+		assert(pix.getWidth() * pix.getHeight() == history.getNumPixels());
 
+		if (use_threads)
 		{
-			T *result_ptr = result.getPixels();
-			T arr[NUM_FRAME];
-
-			for (int n = 0; n < N; n++)
-			{
-				const T *ptr = pixels_ptr + n;
-
-				for (int i = 0; i < NUM_FRAME; i++)
-				{
-					arr[i] = *ptr;
-					ptr += N;
-				}
+			Task task;
+			task.self = this;
+			task.src = pix.getPixels();
+			task.dst = result.getPixels();
 
-				result_ptr[n] = Median<T, NUM_FRAME>::get(arr);
-			}
+			WorkerPool &p = pool ? *pool : WorkerPool::getShared();
+			p.run(task, 0, history.getNumTiles(), TILES_PER_TASK);
+		}
+		else
+		{
+			filter(pix.getPixels(), result.getPixels(), 0, history.getNumTiles());
 		}
 
-		current_frame_index++;
-		current_frame_index %= NUM_FRAME;
+		history.advance();
 
 		return result;
 	}
@@ -177,12 +301,56 @@ public:
 	const ofPixels_<T>& get() const { return result; }
 	ofPixels_<T>& get() { return result; }
 
+	// split the tiles over a WorkerPool (NULL uses WorkerPool::getShared()).
+	// tiles are independent, so the result is identical to the calling
+	// thread only path
+	void setUseThreads(bool v = true, WorkerPool *p = NULL) { use_threads = v; pool = p; }
+	bool getUseThreads() const { return use_threads; }
+
 protected:
 
-	int current_frame_index;
+	typedef TileHistory<T, NUM_FRAME> History;
+
+	enum { TILES_PER_TASK = 512 };
+
+	class Task : public ParallelTask
+	{
+	public:
+
+		TimedomainMedianFilter *self;
+		const T *src;
+		T *dst;
+
+		void run(int begin, int end) { self->filter(src, dst, begin, end); }
+	};
 
-	vector<T> pixels;
+	History history;
 	ofPixels_<T> result;
+
+	bool use_threads;
+	WorkerPool *pool;
+
+	void filter(const T *src, T *dst, int tile_begin, int tile_end)
+	{
+		for (int t = tile_begin; t < tile_end; t++)
+		{
+			const T *tile = history.push(t, src);
+
+			const int offset = t * History::LANES;
+			const int n = history.getTileSize(t);
+
+			if (n == History::LANES)
+			{
+				TileMedian<T, NUM_FRAME>::get(tile, dst + offset);
+			}
+			else
+			{
+				T tmp[History::LANES];
+				TileMedian<T, NUM_FRAME>::get(tile, tmp);
+				memcpy(dst + offset, tmp, n * sizeof(T));
+			}
+		}
+	}
 };
 
 }
\ No newline at end of file
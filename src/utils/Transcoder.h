@@ -0,0 +1,483 @@
+#pragma once
+
+#include "ofxNI2.h"
+#include "utils/RecordingWriter.h"
+
+#include "Poco/Event.h"
+
+namespace ofxNI2
+{
+	class Transcoder;
+}
+
+// converts .oni files of Device::startRecord() into FrameRecorder
+// recordings, optionally cropped, scaled down and with frames skipped.
+//
+// the file is played back in manual mode, so no frame is lost and playback
+// runs as fast as the streams are encoded. the OpenNI thread only copies
+// each frame into the queue of its stream, every stream has an encoder
+// thread of its own. no GL is involved, transcode() works without a window.
+//
+// transcode() blocks until the file is done. run one Transcoder per core to
+// convert many files at once, see example-transcoder.
+
+class ofxNI2::Transcoder : public ofxNI2::FrameListener
+{
+public:
+
+	struct Settings
+	{
+		// depth pixels outside are dropped, empty keeps the whole frame
+		ofRectangle depth_crop;
+
+		// every stream keeps every n-th pixel of every n-th row. depth
+		// isn't averaged, that would make up depth along edges
+		int downscale;
+
+		// every stream keeps every n-th frame
+		int decimation;
+
+		// frames per stream waiting for the encoder
+		int queue_capacity;
+
+		Settings() : downscale(1), decimation(1), queue_capacity(8) {}
+	};
+
+	Transcoder() : cancelled(false), num_frames(0), num_read(0), num_written(0), bytes_written(0), raw_bytes(0) {}
+
+	void setup(const Settings& settings) { this->settings = settings; }
+	const Settings& getSettings() const { return settings; }
+
+	bool transcode(const string& oni_path, const string& path)
+	{
+		if (!ofFile::doesFileExist(oni_path))
+		{
+			ofLogError("ofxNI2::Transcoder") << "no such file " << oni_path;
+			return false;
+		}
+
+		// a broken file fails here and only this job
+		Device device;
+		if (!device.setup(oni_path) || !device.isFile())
+		{
+			ofLogError("ofxNI2::Transcoder") << "can't open " << oni_path;
+			return false;
+		}
+
+		device.setPlaybackRepeat(false);
+		device.setPlaybackSpeed(-1);
+
+		const openni::SensorType types[] = { openni::SENSOR_DEPTH, openni::SENSOR_COLOR, openni::SENSOR_IR };
+
+		vector<recording::StreamHeader> headers;
+
+		for (int i = 0; i < 3; i++)
+		{
+			if (!device.get().hasSensor(types[i])) continue;
+
+			Source *source = new Source;
+			if (!source->setup(device, types[i]))
+			{
+				delete source;
+				continue;
+			}
+
+			Encoder *e = new Encoder(this, encoders.size(), source);
+			e->num_frames = device.getNumFrames(*source);
+
+			if (!e->setup(types[i] == openni::SENSOR_DEPTH ? settings.depth_crop : ofRectangle(), settings.downscale, settings.queue_capacity))
+			{
+				ofLogError("ofxNI2::Transcoder") << "unsupported pixel format in " << oni_path;
+				delete e;
+				continue;
+			}
+
+			headers.push_back(e->header);
+			encoders.push_back(e);
+		}
+
+		bool ok = !encoders.empty() && output.open(path, headers);
+
+		if (ok)
+		{
+			finished.reset();
+
+			mutex.lock();
+			cancelled = false;
+			num_frames = num_read = num_written = 0;
+			bytes_written = output.getSize();
+			raw_bytes = 0;
+
+			for (int i = 0; i < encoders.size(); i++)
+				num_frames += encoders[i]->num_frames;
+			mutex.unlock();
+
+			for (int i = 0; i < encoders.size() && ok; i++)
+			{
+				encoders[i]->startThread(true, false);
+				encoders[i]->source->addFrameListener(this);
+
+				if (!encoders[i]->source->start())
+				{
+					ofLogError("ofxNI2::Transcoder") << "can't play " << oni_path;
+					ok = false;
+				}
+			}
+
+			if (ok) waitForEnd(oni_path);
+		}
+
+		// stops playback, then the encoders finish their queues
+		device.exit();
+
+		for (int i = 0; i < encoders.size(); i++)
+		{
+			Encoder *e = encoders[i];
+
+			if (e->isThreadRunning())
+			{
+				e->stopThread();
+				e->queued.set();
+				e->waitForThread(false);
+			}
+
+			delete e;
+		}
+
+		encoders.clear();
+
+		if (output.isOpen())
+		{
+			output.close();
+
+			mutex.lock();
+			bytes_written = output.getSize();
+			mutex.unlock();
+		}
+
+		return ok && !isCancelled();
+	}
+
+	// from another thread, makes transcode() return early. the file is
+	// closed and readable up to where it stopped
+	void cancel()
+	{
+		mutex.lock();
+		cancelled = true;
+		mutex.unlock();
+
+		finished.set();
+	}
+
+	bool isCancelled() { ofScopedLock lock(mutex); return cancelled; }
+
+	// all thread safe, for watching transcode() from another thread
+
+	// 0 to 1
+	float getProgress() { ofScopedLock lock(mutex); return num_frames > 0 ? (float)num_read / num_frames : 0; }
+
+	int getNumFramesRead() { ofScopedLock lock(mutex); return num_read; }
+	int getNumFramesWritten() { ofScopedLock lock(mutex); return num_written; }
+
+	uint64_t getBytesWritten() { ofScopedLock lock(mutex); return bytes_written; }
+
+	// before cropping, scaling and encoding, of the frames written
+	uint64_t getRawBytes() { ofScopedLock lock(mutex); return raw_bytes; }
+
+protected:
+
+	// no pixel copies or textures like Depth/Color/IrStream
+	class Source : public ofxNI2::Stream
+	{
+	public:
+
+		bool setup(ofxNI2::Device &device, openni::SensorType type) { return Stream::setup(device, type); }
+	};
+
+	struct Slot
+	{
+		vector<unsigned char> data;
+		uint64_t timestamp;
+		int frame_index;
+	};
+
+	class Encoder : public ofThread
+	{
+	public:
+
+		Transcoder *transcoder;
+		int index;
+		Source *source;
+
+		recording::StreamHeader header;
+		int bpp, in_width, in_height;
+		int crop_x, crop_y, scale;
+
+		// frames in the file and read so far, guarded by Transcoder::mutex
+		int num_frames, num_read;
+
+		vector<Slot> slots;
+		int head, count;
+		ofMutex queue_mutex;
+		Poco::Event queued, freed;
+
+		Encoder(Transcoder *transcoder, int index, Source *source) : transcoder(transcoder), index(index), source(source), num_frames(0), num_read(0), head(0), count(0) {}
+		~Encoder()
+		{
+			source->exit();
+			delete source;
+		}
+
+		// false for pixel formats without a fixed size
+		bool setup(ofRectangle crop, int downscale, int queue_capacity)
+		{
+			const openni::VideoStream &s = source->get();
+			const openni::VideoMode mode = s.getVideoMode();
+
+			bpp = recording::getBytesPerPixel(mode.getPixelFormat());
+			if (bpp == 0) return false;
+
+			in_width = mode.getResolutionX();
+			in_height = mode.getResolutionY();
+
+			if (crop.width <= 0 || crop.height <= 0)
+				crop.set(0, 0, in_width, in_height);
+
+			crop_x = ofClamp(crop.x, 0, in_width - 1);
+			crop_y = ofClamp(crop.y, 0, in_height - 1);
+			const int crop_width = ofClamp(crop.width, 1, in_width - crop_x);
+			const int crop_height = ofClamp(crop.height, 1, in_height - crop_y);
+
+			scale = std::max(downscale, 1);
+
+			memset(&header, 0, sizeof(header));
+			header.sensor_type = s.getSensorInfo().getSensorType();
+			header.pixel_format = mode.getPixelFormat();
+			header.width = std::max(crop_width / scale, 1);
+			header.height = std::max(crop_height / scale, 1);
+			header.fps = mode.getFps();
+
+			// pixel (u, v) was (crop_x + u * scale, crop_y + v * scale)
+			const Intrinsics &in = source->getIntrinsics();
+			if (in.isValid())
+			{
+				header.fx = in.fx / scale;
+				header.fy = in.fy / scale;
+				header.cx = (in.cx - crop_x) / scale;
+				header.cy = (in.cy - crop_y) / scale;
+				header.depth_unit = in.depth_unit;
+			}
+
+			slots.resize(std::max(queue_capacity, 1));
+
+			return true;
+		}
+
+		// OpenNI thread. waits for the encoder while the queue is full
+		void push(const Frame &frame)
+		{
+			if (frame.width != in_width || frame.height != in_height)
+			{
+				ofLogError("ofxNI2::Transcoder") << "frame " << frame.frame_index << " changed size, skipped";
+				return;
+			}
+
+			queue_mutex.lock();
+
+			while (count == slots.size())
+			{
+				queue_mutex.unlock();
+				if (transcoder->isCancelled()) return;
+
+				freed.tryWait(10);
+				queue_mutex.lock();
+			}
+
+			const int tail = (head + count) % slots.size();
+			queue_mutex.unlock();
+
+			// only this thread writes to free slots
+			Slot &s = slots[tail];
+			s.timestamp = frame.timestamp;
+			s.frame_index = frame.frame_index;
+
+			const int row_size = in_width * bpp;
+			const int stride = frame.stride;
+			const unsigned char *src = (const unsigned char*)frame.data;
+
+			s.data.resize(row_size * in_height);
+
+			for (int y = 0; y < in_height; y++)
+				memcpy(&s.data[y * row_size], src + y * stride, row_size);
+
+			queue_mutex.lock();
+			count++;
+			queue_mutex.unlock();
+
+			queued.set();
+		}
+
+	protected:
+
+		Slot slot;
+		vector<unsigned char> scaled, encoded;
+
+		void threadedFunction()
+		{
+			while (true)
+			{
+				queue_mutex.lock();
+
+				if (count == 0)
+				{
+					queue_mutex.unlock();
+
+					// the queue is drained before leaving
+					if (!isThreadRunning()) break;
+
+					queued.wait();
+					continue;
+				}
+
+				slot.data.swap(slots[head].data);
+				slot.timestamp = slots[head].timestamp;
+				slot.frame_index = slots[head].frame_index;
+
+				head = (head + 1) % slots.size();
+				count--;
+
+				queue_mutex.unlock();
+
+				freed.set();
+
+				encode();
+			}
+		}
+
+		void encode()
+		{
+			const unsigned char *pixels = &slot.data[0];
+
+			if (header.width != in_width || header.height != in_height)
+			{
+				scaled.resize(header.width * header.height * bpp);
+
+				switch (bpp)
+				{
+					case 1: resample<1>(pixels, &scaled[0]); break;
+					case 2: resample<2>(pixels, &scaled[0]); break;
+					case 3: resample<3>(pixels, &scaled[0]); break;
+				}
+
+				pixels = &scaled[0];
+			}
+
+			recording::FrameHeader h;
+			memset(&h, 0, sizeof(h));
+			h.stream = index;
+			h.frame_index = slot.frame_index;
+			h.timestamp = slot.timestamp;
+			h.width = header.width;
+			h.height = header.height;
+			h.raw_size = header.width * header.height * bpp;
+
+			const unsigned char *payload = RecordingWriter::encode(header, h, pixels, encoded);
+
+			transcoder->write(h, payload, slot.data.size());
+		}
+
+		template <int N>
+		void resample(const unsigned char *src, unsigned char *dst)
+		{
+			struct Pixel { unsigned char v[N]; };
+
+			Pixel *d = (Pixel*)dst;
+
+			for (int y = 0; y < header.height; y++)
+			{
+				const Pixel *s = (const Pixel*)src + (crop_y + y * scale) * in_width + crop_x;
+
+				for (int x = 0; x < header.width; x++)
+					*d++ = s[x * scale];
+			}
+		}
+	};
+
+	Settings settings;
+
+	vector<Encoder*> encoders;
+
+	ofMutex output_mutex;
+	RecordingWriter output;
+
+	Poco::Event finished;
+
+	ofMutex mutex;
+	bool cancelled;
+	int num_frames, num_read, num_written;
+	uint64_t bytes_written, raw_bytes;
+
+	// encoder threads
+	void write(const recording::FrameHeader& h, const unsigned char *payload, size_t raw_size)
+	{
+		output_mutex.lock();
+		const size_t size = output.write(h, payload);
+		output_mutex.unlock();
+
+		ofScopedLock lock(mutex);
+		num_written++;
+		bytes_written += size;
+		raw_bytes += raw_size;
+	}
+
+	// manual playback stops after the last frame without telling, so the
+	// frame counts of the file decide. the timeout covers files where they
+	// are off
+	void waitForEnd(const string& oni_path)
+	{
+		int last_read = -1;
+		int idle = 0;
+
+		while (!isCancelled())
+		{
+			if (finished.tryWait(500)) break;
+
+			const int n = getNumFramesRead();
+
+			if (n != last_read)
+			{
+				last_read = n;
+				idle = 0;
+			}
+			else if (++idle == 10)
+			{
+				ofLogWarning("ofxNI2::Transcoder") << "playback stalled at frame " << n << " of " << num_frames << " in " << oni_path;
+				break;
+			}
+		}
+	}
+
+	void onNewFrame(Stream &stream, const Frame &frame)
+	{
+		for (int i = 0; i < encoders.size(); i++)
+		{
+			Encoder *e = encoders[i];
+			if (e->source != &stream) continue;
+
+			mutex.lock();
+			const int n = e->num_read++;
+			num_read++;
+
+			bool done = true;
+			for (int j = 0; j < encoders.size(); j++)
+				done = done && encoders[j]->num_read >= encoders[j]->num_frames;
+			mutex.unlock();
+
+			if (n % std::max(settings.decimation, 1) == 0)
+				e->push(frame);
+
+			if (done) finished.set();
+			return;
+		}
+	}
+};
@@ -0,0 +1,79 @@
+#pragma once
+
+#include "ofMain.h"
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+namespace ofxNI2
+{
+	template <typename T>
+	class TripleBuffer;
+}
+
+// lock free latest value slot for one writer and one reader thread.
+// the writer fills getBackBuffer() and publish()es it, the reader calls
+// update() and reads getFrontBuffer(). neither side ever waits, values
+// the reader didn't pick up in time are overwritten.
+
+template <typename T>
+class ofxNI2::TripleBuffer
+{
+public:
+
+	TripleBuffer() : middle(1), back(0), front(2) {}
+
+	T& getBackBuffer() { return buffer[back]; }
+
+	// returns true if the previous value was never read
+	bool publish()
+	{
+		const long prev = exchange(back | FRESH);
+		back = prev & INDEX_MASK;
+		return (prev & FRESH) != 0;
+	}
+
+	// true if a new value has been taken over into the front buffer
+	bool update()
+	{
+		if ((middle & FRESH) == 0) return false;
+
+		front = exchange(front) & INDEX_MASK;
+		return true;
+	}
+
+	T& getFrontBuffer() { return buffer[front]; }
+	const T& getFrontBuffer() const { return buffer[front]; }
+
+protected:
+
+	enum
+	{
+		INDEX_MASK = 3,
+		FRESH = 4
+	};
+
+	T buffer[3];
+
+	// index of the middle buffer, plus FRESH if it holds an unread value
+	volatile long middle;
+
+	int back, front;
+
+	// full barrier, so the buffer contents are visible before the index
+	inline long exchange(long v)
+	{
+#ifdef _MSC_VER
+		return _InterlockedExchange(&middle, v);
+#else
+		long prev;
+		do
+		{
+			prev = middle;
+		}
+		while (__sync_val_compare_and_swap(&middle, prev, v) != prev);
+		return prev;
+#endif
+	}
+};
@@ -0,0 +1,343 @@
+#pragma once
+
+#include "ofMain.h"
+
+namespace ofxNI2
+{
+	struct TrackedUser;
+	struct UserTrackFrame;
+
+	namespace usertrack
+	{
+		struct FileHeader;
+		struct FrameHeader;
+
+		class Encoder;
+		class Decoder;
+	}
+}
+
+// NiTE user tracking results without NiTE, as written by
+// ofxNiTE2::UserTrackRecorder and read by UserTrackReader. coordinates
+// are NiTE's: millimeters, z pointing away from the sensor.
+
+struct ofxNI2::TrackedUser
+{
+	// nite::JointType order
+	enum { NUM_JOINTS = 15 };
+
+	int id;
+	bool is_new, is_visible, is_lost;
+
+	// nite::SkeletonState
+	int skeleton_state;
+
+	ofVec3f center_of_mass;
+
+	ofVec3f joint_positions[NUM_JOINTS];
+	ofQuaternion joint_orientations[NUM_JOINTS];
+	float position_confidences[NUM_JOINTS];
+	float orientation_confidences[NUM_JOINTS];
+};
+
+struct ofxNI2::UserTrackFrame
+{
+	// of the depth frame the users were tracked in
+	uint64_t timestamp;
+	int frame_index;
+
+	ofVec3f floor_point, floor_normal;
+	float floor_confidence;
+
+	vector<TrackedUser> users;
+};
+
+// file layout, little endian:
+//
+//   FileHeader
+//   (FrameHeader users) * n
+//
+// FrameHeader is fixed size and says how many bytes of users follow. per
+// user there are 4 bytes of id and states, the quantized values and then
+// a byte per confidence. values are positions in whole millimeters and
+// quaternion components times ORIENTATION_SCALE, each stored as the
+// zigzag varint of its difference to the same user in the previous
+// frame, so a user standing still takes about 150 bytes per frame.
+// keyframes and users new to a frame start from 0, so decoding can start
+// at any keyframe.
+
+namespace ofxNI2
+{
+	namespace usertrack
+	{
+		enum
+		{
+			FILE_MAGIC = 0x5532494E, // "NI2U"
+			VERSION = 1,
+
+			ORIENTATION_SCALE = 16383,
+			CONFIDENCE_SCALE = 255,
+
+			// center of mass, joint positions and orientations
+			NUM_VALUES = 3 + TrackedUser::NUM_JOINTS * 7,
+
+			FLAG_KEYFRAME = 1,
+
+			USER_NEW = 1,
+			USER_VISIBLE = 2,
+			USER_LOST = 4
+		};
+	}
+}
+
+struct ofxNI2::usertrack::FileHeader
+{
+	uint32_t magic;
+	uint32_t version;
+	uint32_t keyframe_interval;
+	uint32_t reserved;
+};
+
+struct ofxNI2::usertrack::FrameHeader
+{
+	uint64_t timestamp;
+	uint32_t frame_index;
+
+	// bytes of user data after the header
+	uint32_t size;
+
+	int32_t floor_point[3];
+	int16_t floor_normal[3];
+	uint8_t floor_confidence;
+	uint8_t flags;
+	uint16_t num_users;
+	uint16_t reserved;
+};
+
+// keeps the previous frame to encode differences
+
+class ofxNI2::usertrack::Encoder
+{
+public:
+
+	// appends the users of frame to out and fills header
+	void encode(const UserTrackFrame& frame, bool keyframe, FrameHeader& header, vector<unsigned char>& out)
+	{
+		if (keyframe) previous.clear();
+
+		header.timestamp = frame.timestamp;
+		header.frame_index = frame.frame_index;
+		header.flags = keyframe ? FLAG_KEYFRAME : 0;
+		header.num_users = frame.users.size();
+		header.reserved = 0;
+
+		for (int i = 0; i < 3; i++)
+		{
+			header.floor_point[i] = roundf(frame.floor_point[i]);
+			header.floor_normal[i] = quantizeUnit(frame.floor_normal[i]);
+		}
+		header.floor_confidence = quantizeConfidence(frame.floor_confidence);
+
+		const size_t begin = out.size();
+
+		current.clear();
+
+		for (int u = 0; u < frame.users.size(); u++)
+		{
+			const TrackedUser &user = frame.users[u];
+
+			out.push_back(user.id & 0xFF);
+			out.push_back((user.id >> 8) & 0xFF);
+			out.push_back((user.is_new ? USER_NEW : 0) | (user.is_visible ? USER_VISIBLE : 0) | (user.is_lost ? USER_LOST : 0));
+			out.push_back(user.skeleton_state);
+
+			Values &v = current[user.id];
+			quantize(user, v);
+
+			map<int, Values>::const_iterator it = previous.find(user.id);
+
+			for (int i = 0; i < NUM_VALUES; i++)
+				putVarint(out, v.v[i] - (it != previous.end() ? it->second.v[i] : 0));
+
+			for (int j = 0; j < TrackedUser::NUM_JOINTS; j++)
+			{
+				out.push_back(quantizeConfidence(user.position_confidences[j]));
+				out.push_back(quantizeConfidence(user.orientation_confidences[j]));
+			}
+		}
+
+		previous.swap(current);
+
+		header.size = out.size() - begin;
+	}
+
+protected:
+
+	struct Values
+	{
+		int v[NUM_VALUES];
+	};
+
+	map<int, Values> previous, current;
+
+	static unsigned char quantizeConfidence(float v)
+	{
+		return ofClamp(v, 0, 1) * CONFIDENCE_SCALE + 0.5;
+	}
+
+	static int quantizeUnit(float v)
+	{
+		return roundf(ofClamp(v, -1, 1) * ORIENTATION_SCALE);
+	}
+
+	static void quantize(const TrackedUser& user, Values& out)
+	{
+		int *v = out.v;
+
+		for (int i = 0; i < 3; i++)
+			*v++ = roundf(user.center_of_mass[i]);
+
+		for (int j = 0; j < TrackedUser::NUM_JOINTS; j++)
+		{
+			const ofVec3f &p = user.joint_positions[j];
+			const ofQuaternion &q = user.joint_orientations[j];
+
+			for (int i = 0; i < 3; i++)
+				*v++ = roundf(p[i]);
+
+			*v++ = quantizeUnit(q.x());
+			*v++ = quantizeUnit(q.y());
+			*v++ = quantizeUnit(q.z());
+			*v++ = quantizeUnit(q.w());
+		}
+	}
+
+	static void putVarint(vector<unsigned char>& out, int value)
+	{
+		unsigned int v = (value << 1) ^ (value >> 31);
+
+		while (v >= 0x80)
+		{
+			out.push_back((v & 0x7F) | 0x80);
+			v >>= 7;
+		}
+		out.push_back(v);
+	}
+};
+
+// decodes frames in file order from a keyframe on
+
+class ofxNI2::usertrack::Decoder
+{
+public:
+
+	// false if data is broken or the previous frame is missing
+	bool decode(const FrameHeader& header, const unsigned char *data, UserTrackFrame& frame)
+	{
+		if (header.flags & FLAG_KEYFRAME) previous.clear();
+
+		frame.timestamp = header.timestamp;
+		frame.frame_index = header.frame_index;
+
+		for (int i = 0; i < 3; i++)
+		{
+			frame.floor_point[i] = header.floor_point[i];
+			frame.floor_normal[i] = header.floor_normal[i] / (float)ORIENTATION_SCALE;
+		}
+		frame.floor_confidence = header.floor_confidence / (float)CONFIDENCE_SCALE;
+
+		frame.users.resize(header.num_users);
+
+		const unsigned char *p = data;
+		const unsigned char *end = data + header.size;
+
+		current.clear();
+
+		for (int u = 0; u < header.num_users; u++)
+		{
+			if (end - p < 4) return false;
+
+			TrackedUser &user = frame.users[u];
+			user.id = (int16_t)(p[0] | (p[1] << 8));
+			user.is_new = p[2] & USER_NEW;
+			user.is_visible = p[2] & USER_VISIBLE;
+			user.is_lost = p[2] & USER_LOST;
+			user.skeleton_state = p[3];
+			p += 4;
+
+			Values &v = current[user.id];
+			map<int, Values>::const_iterator it = previous.find(user.id);
+
+			for (int i = 0; i < NUM_VALUES; i++)
+			{
+				int delta;
+				if (!getVarint(p, end, delta)) return false;
+
+				v.v[i] = delta + (it != previous.end() ? it->second.v[i] : 0);
+			}
+
+			dequantize(v, user);
+
+			if (end - p < TrackedUser::NUM_JOINTS * 2) return false;
+
+			for (int j = 0; j < TrackedUser::NUM_JOINTS; j++)
+			{
+				user.position_confidences[j] = *p++ / (float)CONFIDENCE_SCALE;
+				user.orientation_confidences[j] = *p++ / (float)CONFIDENCE_SCALE;
+			}
+		}
+
+		previous.swap(current);
+
+		return p == end;
+	}
+
+	void reset() { previous.clear(); }
+
+protected:
+
+	struct Values
+	{
+		int v[NUM_VALUES];
+	};
+
+	map<int, Values> previous, current;
+
+	static void dequantize(const Values& in, TrackedUser& user)
+	{
+		const int *v = in.v;
+
+		user.center_of_mass.set(v[0], v[1], v[2]);
+		v += 3;
+
+		for (int j = 0; j < TrackedUser::NUM_JOINTS; j++)
+		{
+			const float s = 1.0 / ORIENTATION_SCALE;
+
+			user.joint_positions[j].set(v[0], v[1], v[2]);
+			user.joint_orientations[j].set(v[3] * s, v[4] * s, v[5] * s, v[6] * s);
+			v += 7;
+		}
+	}
+
+	static bool getVarint(const unsigned char *&p, const unsigned char *end, int& value)
+	{
+		unsigned int v = 0;
+
+		for (int shift = 0; shift < 35; shift += 7)
+		{
+			if (p == end) return false;
+
+			const unsigned char b = *p++;
+			v |= (unsigned int)(b & 0x7F) << shift;
+
+			if (!(b & 0x80))
+			{
+				value = (v >> 1) ^ -(int)(v & 1);
+				return true;
+			}
+		}
+
+		return false;
+	}
+};
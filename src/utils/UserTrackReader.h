@@ -0,0 +1,141 @@
+#pragma once
+
+#include "ofMain.h"
+#include "utils/UserTrackFormat.h"
+
+namespace ofxNI2
+{
+	class UserTrackReader;
+}
+
+// plays back files of ofxNiTE2::UserTrackRecorder, no NiTE needed. the
+// file is loaded at once, frames are decoded on demand from the nearest
+// keyframe, and stepping forward decodes a single frame.
+
+class ofxNI2::UserTrackReader
+{
+public:
+
+	UserTrackReader() : decoded_frame(-1) {}
+
+	bool open(const string& path)
+	{
+		close();
+
+		FILE *fp = fopen(ofToDataPath(path).c_str(), "rb");
+		if (!fp)
+		{
+			ofLogError("ofxNI2::UserTrackReader") << "can't open " << path;
+			return false;
+		}
+
+		fseek(fp, 0, SEEK_END);
+		const long size = ftell(fp);
+		fseek(fp, 0, SEEK_SET);
+
+		data.resize(std::max(size, 0L));
+		const bool ok = size > 0 && fread(&data[0], 1, size, fp) == size;
+		fclose(fp);
+
+		const usertrack::FileHeader *fh = (const usertrack::FileHeader*)&data[0];
+
+		if (!ok
+			|| size < sizeof(usertrack::FileHeader)
+			|| fh->magic != usertrack::FILE_MAGIC
+			|| fh->version != usertrack::VERSION)
+		{
+			ofLogError("ofxNI2::UserTrackReader") << "not a user track file: " << path;
+			close();
+			return false;
+		}
+
+		// a truncated last frame is dropped
+		size_t offset = sizeof(usertrack::FileHeader);
+		int keyframe = -1;
+
+		while (offset + sizeof(usertrack::FrameHeader) <= data.size())
+		{
+			const usertrack::FrameHeader &h = *(const usertrack::FrameHeader*)&data[offset];
+			if (offset + sizeof(h) + h.size > data.size()) break;
+
+			const int i = offsets.size();
+			if (h.flags & usertrack::FLAG_KEYFRAME) keyframe = i;
+
+			// frames before the first keyframe can't be decoded
+			if (keyframe >= 0)
+			{
+				offsets.push_back(offset);
+				timestamps.push_back(h.timestamp);
+				keyframes.push_back(keyframe);
+			}
+
+			offset += sizeof(h) + h.size;
+		}
+
+		return true;
+	}
+
+	void close()
+	{
+		data.clear();
+		offsets.clear();
+		timestamps.clear();
+		keyframes.clear();
+
+		decoded_frame = -1;
+		decoder.reset();
+	}
+
+	bool isOpen() const { return !data.empty(); }
+
+	int getNumFrames() const { return offsets.size(); }
+
+	uint64_t getTimestamp(int frame) const { return timestamps[frame]; }
+
+	// the last frame at or before timestamp, 0 if it's before the first one
+	int findFrame(uint64_t timestamp) const
+	{
+		const int i = std::upper_bound(timestamps.begin(), timestamps.end(), timestamp) - timestamps.begin();
+		return std::max(i - 1, 0);
+	}
+
+	// valid until the next call
+	const UserTrackFrame& getFrame(int i)
+	{
+		assert(i >= 0 && i < offsets.size());
+
+		if (i == decoded_frame) return frame;
+
+		// decoding goes on from the last frame when possible
+		int f = keyframes[i];
+		if (decoded_frame >= f && decoded_frame < i) f = decoded_frame + 1;
+
+		for (; f <= i; f++)
+		{
+			const usertrack::FrameHeader &h = *(const usertrack::FrameHeader*)&data[offsets[f]];
+
+			if (!decoder.decode(h, &data[offsets[f] + sizeof(h)], frame))
+				ofLogError("ofxNI2::UserTrackReader") << "broken frame " << f;
+		}
+
+		decoded_frame = i;
+		return frame;
+	}
+
+	// the frame of the depth frame with this timestamp or the one before
+	const UserTrackFrame& getFrameAt(uint64_t timestamp) { return getFrame(findFrame(timestamp)); }
+
+protected:
+
+	vector<unsigned char> data;
+
+	vector<size_t> offsets;
+	vector<uint64_t> timestamps;
+
+	// the keyframe decoding of each frame starts at
+	vector<int> keyframes;
+
+	usertrack::Decoder decoder;
+	UserTrackFrame frame;
+	int decoded_frame;
+};
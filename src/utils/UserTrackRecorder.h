@@ -0,0 +1,151 @@
+#pragma once
+
+#include "ofxNiTE2.h"
+#include "utils/UserTrackFormat.h"
+
+#ifdef HAVE_NITE2
+
+namespace ofxNiTE2
+{
+	class UserTrackRecorder;
+}
+
+// records the users of every UserTracker frame, see UserTrackFormat.h.
+// frames are a few hundred bytes, so they are encoded and written through
+// a buffered FILE right on the NiTE thread.
+//
+// ofxNI2::UserTrackReader plays them back without NiTE.
+
+class ofxNiTE2::UserTrackRecorder : public ofxNiTE2::UserFrameListener
+{
+public:
+
+	UserTrackRecorder() : tracker(NULL), file(NULL), keyframe_interval(30), num_frames(0) {}
+	~UserTrackRecorder() { stop(); }
+
+	// every keyframe_interval frames decoding can start over
+	bool start(UserTracker &tracker, const string& path, int keyframe_interval = 30)
+	{
+		stop();
+
+		file = fopen(ofToDataPath(path).c_str(), "wb");
+		if (!file)
+		{
+			ofLogError("ofxNiTE2::UserTrackRecorder") << "can't open " << path;
+			return false;
+		}
+
+		setvbuf(file, NULL, _IOFBF, 1 << 16);
+
+		this->keyframe_interval = std::max(keyframe_interval, 1);
+		num_frames = 0;
+
+		ofxNI2::usertrack::FileHeader fh;
+		fh.magic = ofxNI2::usertrack::FILE_MAGIC;
+		fh.version = ofxNI2::usertrack::VERSION;
+		fh.keyframe_interval = this->keyframe_interval;
+		fh.reserved = 0;
+
+		fwrite(&fh, sizeof(fh), 1, file);
+
+		this->tracker = &tracker;
+		tracker.addFrameListener(this);
+
+		return true;
+	}
+
+	void stop()
+	{
+		if (!tracker) return;
+
+		// no more callbacks after this
+		tracker->removeFrameListener(this);
+		tracker = NULL;
+
+		ofScopedLock lock(mutex);
+
+		fclose(file);
+		file = NULL;
+	}
+
+	bool isRecording() const { return tracker != NULL; }
+
+	int getNumFrames() { ofScopedLock lock(mutex); return num_frames; }
+
+	static void convert(const nite::UserTrackerFrameRef &src, ofxNI2::UserTrackFrame &dst)
+	{
+		// keyed by the depth frame, like the streams of a recording
+		openni::VideoFrameRef depth = const_cast<nite::UserTrackerFrameRef&>(src).getDepthFrame();
+
+		dst.timestamp = depth.isValid() ? depth.getTimestamp() : src.getTimestamp();
+		dst.frame_index = depth.isValid() ? depth.getFrameIndex() : src.getFrameIndex();
+
+		const nite::Plane &floor = src.getFloor();
+		dst.floor_point.set(floor.point.x, floor.point.y, floor.point.z);
+		dst.floor_normal.set(floor.normal.x, floor.normal.y, floor.normal.z);
+		dst.floor_confidence = src.getFloorConfidence();
+
+		const nite::Array<nite::UserData> &users = src.getUsers();
+		dst.users.resize(users.getSize());
+
+		for (int i = 0; i < users.getSize(); i++)
+		{
+			const nite::UserData &u = users[i];
+			ofxNI2::TrackedUser &o = dst.users[i];
+
+			o.id = u.getId();
+			o.is_new = u.isNew();
+			o.is_visible = u.isVisible();
+			o.is_lost = u.isLost();
+			o.skeleton_state = u.getSkeleton().getState();
+
+			const nite::Point3f &com = u.getCenterOfMass();
+			o.center_of_mass.set(com.x, com.y, com.z);
+
+			for (int j = 0; j < ofxNI2::TrackedUser::NUM_JOINTS; j++)
+			{
+				const nite::SkeletonJoint &joint = u.getSkeleton().getJoint((nite::JointType)j);
+				const nite::Point3f &p = joint.getPosition();
+				const nite::Quaternion &q = joint.getOrientation();
+
+				o.joint_positions[j].set(p.x, p.y, p.z);
+				o.joint_orientations[j].set(q.x, q.y, q.z, q.w);
+				o.position_confidences[j] = joint.getPositionConfidence();
+				o.orientation_confidences[j] = joint.getOrientationConfidence();
+			}
+		}
+	}
+
+protected:
+
+	UserTracker *tracker;
+
+	ofMutex mutex;
+	FILE *file;
+
+	int keyframe_interval;
+	int num_frames;
+
+	ofxNI2::UserTrackFrame frame;
+	ofxNI2::usertrack::Encoder encoder;
+	vector<unsigned char> buffer;
+
+	void onNewFrame(UserTracker &tracker, const nite::UserTrackerFrameRef &src)
+	{
+		ofScopedLock lock(mutex);
+		if (!file) return;
+
+		convert(src, frame);
+
+		ofxNI2::usertrack::FrameHeader h;
+		buffer.clear();
+		encoder.encode(frame, num_frames % keyframe_interval == 0, h, buffer);
+
+		fwrite(&h, sizeof(h), 1, file);
+		if (!buffer.empty()) fwrite(&buffer[0], 1, buffer.size(), file);
+
+		num_frames++;
+	}
+};
+
+#endif
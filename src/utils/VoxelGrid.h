@@ -0,0 +1,265 @@
+#pragma once
+
+#include "ofxNI2.h"
+
+namespace ofxNI2
+{
+	class VoxelGrid;
+};
+
+// voxel-grid downsampling: one averaged point per occupied voxel.
+// the hash table is allocated once and reused across frames, so the
+// number of output points is bounded by getMaxVoxels()
+
+class ofxNI2::VoxelGrid
+{
+public:
+
+	VoxelGrid() : leaf_size(20), inv_leaf_size(1. / 20), max_voxels(0), table_mask(0), current_stamp(0), num_dropped(0)
+	{
+		setMaxVoxels(1 << 16);
+	}
+
+	void setup(DepthStream& depth_stream)
+	{
+		setup(depth_stream.getIntrinsics());
+	}
+
+	void setup(const Intrinsics& intrinsics)
+	{
+		this->intrinsics = intrinsics;
+	}
+
+	// from depth frame, points are in the same space as MeshGenerator
+	const ofMesh& update(const ofShortPixels& depth, const ofPixels& color = ofPixels())
+	{
+		assert(depth.getNumChannels() == 1);
+
+		const int W = depth.getWidth();
+		const int H = depth.getHeight();
+
+		if (intrinsics.isValid()
+			&& (intrinsics.width != W || intrinsics.height != H))
+			intrinsics = intrinsics.getScaled(W, H);
+
+		const unsigned short *depth_pix = depth.getPixels();
+
+		const bool has_color = color.isAllocated();
+		const int C = has_color ? color.getNumChannels() : 0;
+		const unsigned char *color_pix = has_color ? color.getPixels() : NULL;
+		const float inv_byte = 1. / 255.;
+
+		if (has_color && C != 1 && C != 3) throw;
+
+		begin();
+
+		for (int y = 0; y < H; y++)
+		{
+			for (int x = 0; x < W; x++)
+			{
+				const int idx = y * W + x;
+				if (depth_pix[idx] == 0) continue;
+
+				float X, Y, Z;
+				intrinsics.unproject(x, y, depth_pix[idx], X, Y, Z);
+
+				Cell *cell = lookup(X, Y, -Z);
+				if (!cell) continue;
+
+				cell->sum.x += X;
+				cell->sum.y += Y;
+				cell->sum.z -= Z;
+
+				if (has_color)
+				{
+					const unsigned char *c = &color_pix[idx * C];
+					cell->color_sum.r += c[0] * inv_byte;
+					cell->color_sum.g += c[C == 3 ? 1 : 0] * inv_byte;
+					cell->color_sum.b += c[C == 3 ? 2 : 0] * inv_byte;
+				}
+
+				cell->count++;
+			}
+		}
+
+		end(has_color);
+
+		return mesh;
+	}
+
+	// from a generated point cloud (e.g. MeshGenerator::getMesh())
+	const ofMesh& update(ofMesh& cloud)
+	{
+		const vector<ofVec3f>& verts = cloud.getVertices();
+		const vector<ofFloatColor>& cols = cloud.getColors();
+
+		const bool has_color = cols.size() == verts.size();
+
+		begin();
+
+		for (int i = 0; i < verts.size(); i++)
+		{
+			const ofVec3f& v = verts[i];
+			if (v.z == 0) continue;
+
+			Cell *cell = lookup(v.x, v.y, v.z);
+			if (!cell) continue;
+
+			cell->sum += v;
+
+			if (has_color)
+			{
+				cell->color_sum.r += cols[i].r;
+				cell->color_sum.g += cols[i].g;
+				cell->color_sum.b += cols[i].b;
+			}
+
+			cell->count++;
+		}
+
+		end(has_color);
+
+		return mesh;
+	}
+
+	void draw()
+	{
+		mesh.draw();
+	}
+
+	// voxel edge length in mm
+	void setLeafSize(float v) { leaf_size = v; inv_leaf_size = 1. / v; }
+	float getLeafSize() const { return leaf_size; }
+
+	// upper bound of output points. points falling into new voxels
+	// beyond this are dropped and counted in getNumDropped()
+	void setMaxVoxels(int n)
+	{
+		max_voxels = n;
+
+		int size = 1;
+		while (size < n * 2) size <<= 1;
+
+		table.clear();
+		table.resize(size);
+		table_mask = size - 1;
+
+		occupied.clear();
+		occupied.reserve(n);
+
+		current_stamp = 0;
+	}
+	int getMaxVoxels() const { return max_voxels; }
+
+	int getNumVoxels() const { return occupied.size(); }
+	int getNumDropped() const { return num_dropped; }
+
+	ofMesh& getMesh() { return mesh; }
+
+protected:
+
+	struct Cell
+	{
+		uint64_t key;
+		unsigned int stamp;
+		unsigned int count;
+		ofVec3f sum;
+		ofFloatColor color_sum;
+
+		Cell() : key(0), stamp(0), count(0) {}
+	};
+
+	float leaf_size, inv_leaf_size;
+	int max_voxels;
+
+	vector<Cell> table;
+	vector<int> occupied;
+	unsigned int table_mask;
+	unsigned int current_stamp;
+	int num_dropped;
+
+	Intrinsics intrinsics;
+	ofMesh mesh;
+
+	void begin()
+	{
+		occupied.clear();
+		num_dropped = 0;
+
+		// cells stamped with an older frame count as empty, so the
+		// table never has to be cleared
+		current_stamp++;
+		if (current_stamp == 0)
+		{
+			for (int i = 0; i < table.size(); i++)
+				table[i].stamp = 0;
+			current_stamp = 1;
+		}
+	}
+
+	void end(bool has_color)
+	{
+		mesh.setMode(OF_PRIMITIVE_POINTS);
+
+		vector<ofVec3f>& verts = mesh.getVertices();
+		verts.resize(occupied.size());
+
+		vector<ofFloatColor>& cols = mesh.getColors();
+		cols.resize(has_color ? occupied.size() : 0);
+
+		for (int i = 0; i < occupied.size(); i++)
+		{
+			const Cell& cell = table[occupied[i]];
+			const float inv_count = 1. / cell.count;
+
+			verts[i] = cell.sum * inv_count;
+
+			if (has_color)
+			{
+				cols[i].set(cell.color_sum.r * inv_count,
+							cell.color_sum.g * inv_count,
+							cell.color_sum.b * inv_count);
+			}
+		}
+	}
+
+	inline Cell* lookup(float x, float y, float z)
+	{
+		const int ix = floorf(x * inv_leaf_size);
+		const int iy = floorf(y * inv_leaf_size);
+		const int iz = floorf(z * inv_leaf_size);
+
+		const uint64_t key = ((uint64_t)(ix & 0x1FFFFF) << 42)
+			| ((uint64_t)(iy & 0x1FFFFF) << 21)
+			| (uint64_t)(iz & 0x1FFFFF);
+
+		unsigned int slot = (unsigned int)((key * 0x9E3779B97F4A7C15ULL) >> 32) & table_mask;
+
+		while (true)
+		{
+			Cell &cell = table[slot];
+
+			if (cell.stamp != current_stamp)
+			{
+				if (occupied.size() >= max_voxels)
+				{
+					num_dropped++;
+					return NULL;
+				}
+
+				cell.key = key;
+				cell.stamp = current_stamp;
+				cell.count = 0;
+				cell.sum.set(0, 0, 0);
+				cell.color_sum.set(0, 0, 0);
+
+				occupied.push_back(slot);
+				return &cell;
+			}
+
+			if (cell.key == key) return &cell;
+
+			slot = (slot + 1) & table_mask;
+		}
+	}
+};
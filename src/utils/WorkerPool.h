@@ -0,0 +1,170 @@
+#pragma once
+
+#include "ofMain.h"
+
+#include "Poco/Event.h"
+#include "Poco/Environment.h"
+
+namespace ofxNI2
+{
+	class ParallelTask;
+	class WorkerPool;
+}
+
+// unit of work for WorkerPool::run(). run() is called with disjoint
+// [begin, end) ranges from several threads at once
+
+class ofxNI2::ParallelTask
+{
+public:
+
+	virtual ~ParallelTask() {}
+	virtual void run(int begin, int end) = 0;
+};
+
+// persistent worker threads for data parallel loops. the calling thread
+// takes part in the work and run() returns when every chunk is done
+
+class ofxNI2::WorkerPool
+{
+public:
+
+	WorkerPool() : task(NULL), next_index(0), end_index(0), grain_size(1) {}
+	~WorkerPool() { exit(); }
+
+	// num_threads includes the calling thread. 0 means one per core
+	void setup(int num_threads = 0)
+	{
+		exit();
+
+		if (num_threads <= 0)
+			num_threads = Poco::Environment::processorCount();
+
+		for (int i = 1; i < num_threads; i++)
+		{
+			Worker *w = new Worker(this);
+			w->startThread(true, false);
+			workers.push_back(w);
+		}
+	}
+
+	void exit()
+	{
+		for (int i = 0; i < workers.size(); i++)
+		{
+			Worker *w = workers[i];
+			w->stopThread();
+			w->start.set();
+			w->waitForThread(false);
+			delete w;
+		}
+
+		workers.clear();
+	}
+
+	int getNumThreads() const { return workers.size() + 1; }
+
+	// splits [begin, end) into chunks of grain items. nested or concurrent
+	// calls fall back to running on the calling thread
+	void run(ParallelTask &t, int begin, int end, int grain = 1)
+	{
+		if (begin >= end) return;
+		if (grain < 1) grain = 1;
+
+		if (workers.empty()
+			|| end - begin <= grain
+			|| !run_mutex.tryLock())
+		{
+			t.run(begin, end);
+			return;
+		}
+
+		task = &t;
+		next_index = begin;
+		end_index = end;
+		grain_size = grain;
+
+		for (int i = 0; i < workers.size(); i++)
+			workers[i]->start.set();
+
+		work();
+
+		for (int i = 0; i < workers.size(); i++)
+			workers[i]->done.wait();
+
+		task = NULL;
+
+		run_mutex.unlock();
+	}
+
+	// process wide pool, set up on first use
+	static WorkerPool& getShared()
+	{
+		// the first use may come from a capture or pipeline thread
+		static ofMutex mutex;
+		static WorkerPool pool;
+		static bool inited = false;
+
+		ofScopedLock lock(mutex);
+
+		if (!inited)
+		{
+			inited = true;
+			pool.setup();
+		}
+
+		return pool;
+	}
+
+protected:
+
+	class Worker : public ofThread
+	{
+	public:
+
+		Poco::Event start, done;
+
+		Worker(WorkerPool *pool) : pool(pool) {}
+
+	protected:
+
+		WorkerPool *pool;
+
+		void threadedFunction()
+		{
+			while (true)
+			{
+				start.wait();
+				if (!isThreadRunning()) break;
+
+				pool->work();
+				done.set();
+			}
+		}
+	};
+
+	vector<Worker*> workers;
+
+	ofMutex run_mutex;
+	ofMutex chunk_mutex;
+
+	ParallelTask *task;
+	int next_index, end_index, grain_size;
+
+	void work()
+	{
+		while (true)
+		{
+			int b;
+
+			chunk_mutex.lock();
+			b = next_index;
+			next_index += grain_size;
+			chunk_mutex.unlock();
+
+			if (b >= end_index) break;
+
+			task->run(b, std::min(b + grain_size, end_index));
+		}
+	}
+};